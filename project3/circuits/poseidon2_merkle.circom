@@ -0,0 +1,221 @@
+pragma circom 2.0.0;
+include "circomlib/bitify.circom";
+
+// 按 project4 的 Poseidon2HashPolicy（merkle_tree.cpp）编写的 Merkle 树哈希，用于证明其生成的树根。
+// 与 C++ 是否逐位一致以 make merkle-test 为准：它编译 poseidon2_merkle_test.circom，用下面的测试向量生成见证。
+// 注意：poseidon2_t2.circom 使用的是 circomlib 的 Poseidon(2)（原始 Poseidon，t = 3），与此处不是同一个函数。
+//
+// 置换：Poseidon2，BN254 标量域，t = 2，S 盒 x^5，4 + 56 + 4 轮，与 project4/poseidon2.h 的 poseidon2_t2_permute 相同。
+//   第一轮之前先乘一次外部矩阵 [[2, 1], [1, 2]]；部分轮只对 state[0] 加常量、过 S 盒，再乘内部矩阵 [[2, 1], [1, 3]]。
+//   轮常量由 Grain LFSR 生成，按顺序取用：每个完整轮 2 个，每个部分轮 1 个，共 72 个。
+// 海绵：rate 1，capacity 1。state = [0, tag]，依次把每个输入加到 state[0] 后置换一次，输出 state[0]。
+//   叶子：tag = 4 * 字节数；数据按 31 字节分块，每块放在 32 字节大端数的低 31 字节（末块右侧补 0），空数据也吸收一块 0
+//   内部节点：tag = 4 * arity + 1，依次吸收 arity 个孩子
+//
+// 测试向量（十进制）：
+//   Poseidon2MerkleLeaf(3)("abc")          = 20278233922038993267821535680459364329598403779322560763065996921773026236116
+//   Poseidon2MerkleLeaf(0)()               = 15621590199821056450610068202457788725601603091791048810523422053872049975191
+//   Poseidon2MerkleNode(2)([abc, 空])      = 20452911377812420064006725599177621592420834215034465404198434592413361839539
+//   Poseidon2MerkleNode(4)([abc, 空, abc, 空]) = 4710647327929040605832581203117166526364608786698604223062016808220143800244
+
+function POSEIDON2_T2_RC() {
+    return [
+        4417881134626180770308697923359573201005643519861877412381846989312604493735,
+        5433650512959517612316327474713065966758808864213826738576266661723522780033,
+        13641176377184356099764086973022553863760045607496549923679278773208775739952,
+        17949713444224994136330421782109149544629237834775211751417461773584374506783,
+        13765628375339178273710281891027109699578766420463125835325926111705201856003,
+        19179513468172002314585757290678967643352171735526887944518845346318719730387,
+        5157412437176756884543472904098424903141745259452875378101256928559722612176,
+        535160875740282236955320458485730000677124519901643397458212725410971557409,
+        1050793453380762984940163090920066886770841063557081906093018330633089036729,
+        10665495010329663932664894101216428400933984666065399374198502106997623173873,
+        19965634623406616956648724894636666805991993496469370618546874926025059150737,
+        13007250030070838431593222885902415182312449212965120303174723305710127422213,
+        16877538715074991604507979123743768693428157847423939051086744213162455276374,
+        18211747749504876135588847560312685184956239426147543810126553367063157141465,
+        18151553319826126919739798892854572062191241985315767086020821632812331245635,
+        19957033149976712666746140949846950406660099037474791840946955175819555930825,
+        3469514863538261843186854830917934449567467100548474599735384052339577040841,
+        989698510043911779243192466312362856042600749099921773896924315611668507708,
+        12568377015646290945235387813564567111330046038050864455358059568128000172201,
+        20856104135605479600325529349246932565148587186338606236677138505306779314172,
+        8206918720503535523121349917159924938835810381723474192155637697065780938424,
+        1309058477013932989380617265069188723120054926187607548493110334522527703566,
+        14076116939332667074621703729512195584105250395163383769419390236426287710606,
+        10153498892749751942204288991871286290442690932856658983589258153608012428674,
+        18202499207234128286137597834010475797175973146805180988367589376893530181575,
+        12739388830157083522877690211447248168864006284243907142044329113461613743052,
+        15123358710467780770838026754240340042441262572309759635224051333176022613949,
+        19925004701844594370904593774447343836015483888496504201331110250494635362184,
+        10352416606816998476681131583320899030072315953910679608943150613208329645891,
+        10567371822366244361703342347428230537114808440249611395507235283708966113221,
+        5635498582763880627392290206431559361272660937399944184533035305989295959602,
+        11866432933224219174041051738704352719163271639958083608224676028593315904909,
+        5795020705294401441272215064554385591292330721703923167136157291459784140431,
+        9482202378699252817564375087302794636287866584767523335624368774856230692758,
+        4245237636894546151746468406560945873445548423466753843402086544922216329298,
+        12000500941313982757584712677991730019124834399479314697467598397927435905133,
+        7596790274058425558167520209857956363736666939016807569082239187494363541787,
+        2484867918246116343205467273440098378820186751202461278013576281097918148877,
+        18312645949449997391810445935615409295369169383463185688973803378104013950190,
+        15320686572748723004980855263301182130424010735782762814513954166519592552733,
+        12618438900597948888520621062416758747872180395546164387827245287017031303859,
+        17438141672027706116733201008397064011774368832458707512367404736905021019585,
+        6374197807230665998865688675365359100400438034755781666913068586172586548950,
+        2189398913433273865510950346186699930188746169476472274335177556702504595264,
+        6268495580028970231803791523870131137294646402347399003576649137450213034606,
+        17896250365994900261202920044129628104272791547990619503076839618914047059275,
+        13692156312448722528008862371944543449350293305158722920787736248435893008873,
+        15234446864368744483209945022439268713300180233589581910497691316744177619376,
+        1572426502623310766593681563281600503979671244997798691029595521622402217227,
+        80103447810215150918585162168214870083573048458555897999822831203653996617,
+        8228820324013669567851850635126713973797711779951230446503353812192849106342,
+        5375851433746509614045812476958526065449377558695752132494533666370449415873,
+        12115998939203497346386774317892338270561208357481805380546938146796257365018,
+        9764067909645821279940531410531154041386008396840887338272986634350423466622,
+        8538708244538850542384936174629541085495830544298260335345008245230827876882,
+        7140127896620013355910287215441004676619168261422440177712039790284719613114,
+        14297402962228458726038826185823085337698917275385741292940049024977027409762,
+        6667115556431351074165934212337261254608231545257434281887966406956835140819,
+        20226761165244293291042617464655196752671169026542832236139342122602741090001,
+        12038289506489256655759141386763477208196694421666339040483042079632134429119,
+        19027757334170818571203982241812412991528769934917288000224335655934473717551,
+        16272152964456553579565580463468069884359929612321610357528838696790370074720,
+        2500392889689246014710135696485946334448570271481948765283016105301740284071,
+        8595254970528530312401637448610398388203855633951264114100575485022581946023,
+        11635945688914011450976408058407206367914559009113158286982919675551688078198,
+        614739068603482619581328040478536306925147663946742687395148680260956671871,
+        18692271780377861570175282183255720350972693125537599213951106550953176268753,
+        4987059230784976306647166378298632695585915319042844495357753339378260807164,
+        21851403978498723616722415377430107676258664746210815234490134600998983955497,
+        9830635451186415300891533983087800047564037813328875992115573428596207326204,
+        4842706106434537116860242620706030229206345167233200482994958847436425185478,
+        6422235064906823218421386871122109085799298052314922856340127798647926126490
+    ];
+}
+
+template Poseidon2Sbox() {
+    signal input in;
+    signal output out;
+    signal x2;
+    signal x4;
+    x2 <== in * in;
+    x4 <== x2 * x2;
+    out <== x4 * in;
+}
+
+template Poseidon2T2Permutation() {
+    signal input in[2];
+    signal output out[2];
+
+    var RC[72] = POSEIDON2_T2_RC();
+    component sbox[72];
+    var n = 0;     // 已用的 S 盒与常量个数（二者相同）
+    var s0 = 2 * in[0] + in[1];
+    var s1 = in[0] + 2 * in[1];
+    var t0;
+    var t1;
+
+    for (var r = 0; r < 8; r++) {
+        if (r == 4) {
+            // 4 个完整轮之后是 56 个部分轮
+            for (var k = 0; k < 56; k++) {
+                sbox[n] = Poseidon2Sbox();
+                sbox[n].in <== s0 + RC[n];
+                t0 = 2 * sbox[n].out + s1;
+                t1 = sbox[n].out + 3 * s1;
+                s0 = t0;
+                s1 = t1;
+                n += 1;
+            }
+        }
+        sbox[n] = Poseidon2Sbox();
+        sbox[n].in <== s0 + RC[n];
+        sbox[n + 1] = Poseidon2Sbox();
+        sbox[n + 1].in <== s1 + RC[n + 1];
+        s0 = 2 * sbox[n].out + sbox[n + 1].out;
+        s1 = sbox[n].out + 2 * sbox[n + 1].out;
+        n += 2;
+    }
+
+    out[0] <== s0;
+    out[1] <== s1;
+}
+
+// 吸收 n 个域元素，capacity 初值为 tag
+template Poseidon2T2Sponge(n, tag) {
+    signal input in[n];
+    signal output out;
+
+    component perm[n];
+    for (var i = 0; i < n; i++) {
+        perm[i] = Poseidon2T2Permutation();
+        if (i == 0) {
+            perm[i].in[0] <== in[0];
+            perm[i].in[1] <== tag;
+        } else {
+            perm[i].in[0] <== perm[i - 1].out[0] + in[i];
+            perm[i].in[1] <== perm[i - 1].out[1];
+        }
+    }
+    out <== perm[n - 1].out[0];
+}
+
+// 叶子哈希，len 为数据的字节数；每个字节限制在 [0, 256)
+template Poseidon2MerkleLeaf(len) {
+    signal input data[len];
+    signal output out;
+
+    var chunks = len == 0 ? 1 : (len + 30) \ 31;
+    component bytes[len];
+    component sponge = Poseidon2T2Sponge(chunks, 4 * len);
+    for (var c = 0; c < chunks; c++) {
+        var packed = 0;
+        for (var k = 0; k < 31; k++) {
+            var i = c * 31 + k;
+            if (i < len) {
+                bytes[i] = Num2Bits(8);
+                bytes[i].in <== data[i];
+                packed += data[i] * (256 ** (30 - k));
+            }
+        }
+        sponge.in[c] <== packed;
+    }
+    out <== sponge.out;
+}
+
+template Poseidon2MerkleNode(arity) {
+    signal input children[arity];
+    signal output out;
+
+    component sponge = Poseidon2T2Sponge(arity, 4 * arity + 1);
+    for (var k = 0; k < arity; k++) {
+        sponge.in[k] <== children[k];
+    }
+    out <== sponge.out;
+}
+
+// 二叉树（MerkleTree<2, Poseidon2HashPolicy>）的存在性证明：由叶子哈希和 depth 层兄弟推出根。
+// pathBits[i] 为第 i 层当前节点下标的最低位（1 表示当前节点在右侧）。
+// C++ 审计路径可以直接作为 siblings，奇数层补齐位置上本来就是当前节点自身
+template Poseidon2MerkleProof(depth) {
+    signal input leaf;
+    signal input siblings[depth];
+    signal input pathBits[depth];
+    signal output root;
+
+    component nodes[depth];
+    signal current[depth + 1];
+    signal left[depth];
+    current[0] <== leaf;
+    for (var i = 0; i < depth; i++) {
+        pathBits[i] * (pathBits[i] - 1) === 0;
+        left[i] <== current[i] + pathBits[i] * (siblings[i] - current[i]);
+        nodes[i] = Poseidon2MerkleNode(2);
+        nodes[i].children[0] <== left[i];
+        nodes[i].children[1] <== current[i] + siblings[i] - left[i];
+        current[i + 1] <== nodes[i].out;
+    }
+    root <== current[depth];
+}
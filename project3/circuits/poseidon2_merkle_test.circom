@@ -0,0 +1,45 @@
+pragma circom 2.0.0;
+include "poseidon2_merkle.circom";
+
+// poseidon2_merkle.circom 文件头测试向量的检查电路，由 make merkle-test 编译并生成见证。
+// 期望值是公开输入（见 inputs/poseidon2_merkle_test.json），任何一个不等时生成见证失败。
+// 另外用 1 层的 Poseidon2MerkleProof 由 [abc, 空] 推出 2 叉向量，检查路径选择
+template Poseidon2MerkleVectors() {
+    signal input abc[3];
+    signal input leafAbc;
+    signal input leafEmpty;
+    signal input node2;
+    signal input node4;
+
+    component leaf = Poseidon2MerkleLeaf(3);
+    for (var i = 0; i < 3; i++) {
+        leaf.data[i] <== abc[i];
+    }
+    leaf.out === leafAbc;
+
+    component empty = Poseidon2MerkleLeaf(0);
+    empty.out === leafEmpty;
+
+    component pair = Poseidon2MerkleNode(2);
+    pair.children[0] <== leaf.out;
+    pair.children[1] <== empty.out;
+    pair.out === node2;
+
+    component quad = Poseidon2MerkleNode(4);
+    for (var k = 0; k < 4; k++) {
+        if (k % 2 == 0) {
+            quad.children[k] <== leaf.out;
+        } else {
+            quad.children[k] <== empty.out;
+        }
+    }
+    quad.out === node4;
+
+    component proof = Poseidon2MerkleProof(1);
+    proof.leaf <== leaf.out;
+    proof.siblings[0] <== empty.out;
+    proof.pathBits[0] <== 0;
+    proof.root === node2;
+}
+
+component main {public [leafAbc, leafEmpty, node2, node4]} = Poseidon2MerkleVectors();
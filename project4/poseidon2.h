@@ -0,0 +1,240 @@
+#ifndef POSEIDON2_H
+#define POSEIDON2_H
+
+// Poseidon2 置换（t = 2，BN254 标量域，S 盒 x^5，4 + 56 + 4 轮），与 HorizenLabs 参考实现一致，
+// 供 Merkle 树生成 ZK 电路中可证明的根。域元素用 4 个 64 比特字（小端）的 Montgomery 形式表示。
+// 测试向量：permute([0, 1]) = [0x1d01e56f49579cec72319e145f06f6177f6c5253206e78c2689781452a31878b,
+//                              0x0d189ec589c41b8cffa88cfc523618a055abe8192c70f75aa72fc514560f6c61]
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BN254_FR_SIZE 32
+
+typedef struct {
+    uint64_t v[4];      // Montgomery 形式 x * 2^256 mod p，小端字序
+} bn254_fr;
+
+// p = 21888242871839275222246405745257275088548364400416034343698204186575808495617
+static const uint64_t BN254_FR_P[4] = {0x43e1f593f0000001, 0x2833e84879b97091, 0xb85045b68181585d, 0x30644e72e131a029};
+static const uint64_t BN254_FR_INV = 0xc2e1f593efffffff;   // -p^-1 mod 2^64
+static const uint64_t BN254_FR_R2[4] = {0x1bb8e645ae216da7, 0x53fe3ab1e35c59e3, 0x8c49833d53bb8085, 0x0216d0b17f4e44a5};
+
+// a >= p 时减去 p。p < 2^254，加法和 Montgomery 乘法的结果都小于 2p，一次即可
+static inline void bn254_fr_reduce_once(uint64_t *a) {
+    uint64_t t[4];
+    unsigned __int128 borrow = 0;
+    for (int i = 0; i < 4; i++) {
+        unsigned __int128 d = (unsigned __int128) a[i] - BN254_FR_P[i] - borrow;
+        t[i] = (uint64_t) d;
+        borrow = (d >> 64) & 1;
+    }
+    if (!borrow) memcpy(a, t, sizeof(t));
+}
+
+static inline void bn254_fr_add(bn254_fr *r, const bn254_fr *a, const bn254_fr *b) {
+    unsigned __int128 carry = 0;
+    for (int i = 0; i < 4; i++) {
+        carry += (unsigned __int128) a->v[i] + b->v[i];
+        r->v[i] = (uint64_t) carry;
+        carry >>= 64;
+    }
+    bn254_fr_reduce_once(r->v);
+}
+
+// Montgomery 乘法（CIOS）：r = a * b * 2^-256 mod p。
+// p 的最高字小于 2^62，中间结果不会超出 4 个字，省去第 5、6 个字的进位（同 gnark 的 no-carry 优化）
+static inline void bn254_fr_mul(bn254_fr *r, const bn254_fr *a, const bn254_fr *b) {
+    uint64_t t[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        uint64_t bi = b->v[i];
+        unsigned __int128 A = (unsigned __int128) a->v[0] * bi + t[0];
+        uint64_t t0 = (uint64_t) A;
+        A >>= 64;
+        uint64_t m = t0 * BN254_FR_INV;
+        unsigned __int128 C = ((unsigned __int128) m * BN254_FR_P[0] + t0) >> 64;
+        for (int j = 1; j < 4; j++) {
+            A += (unsigned __int128) a->v[j] * bi + t[j];
+            C += (unsigned __int128) m * BN254_FR_P[j] + (uint64_t) A;
+            A >>= 64;
+            t[j - 1] = (uint64_t) C;
+            C >>= 64;
+        }
+        t[3] = (uint64_t) (C + A);
+    }
+    memcpy(r->v, t, sizeof(r->v));
+    bn254_fr_reduce_once(r->v);
+}
+
+// 由 32 字节大端整数得到域元素，不小于 p 的输入按模 p 约化
+static inline void bn254_fr_from_bytes(bn254_fr *r, const uint8_t *in) {
+    bn254_fr x;
+    for (int i = 0; i < 4; i++) {
+        uint64_t w = 0;
+        for (int k = 0; k < 8; k++) w = (w << 8) | in[(3 - i) * 8 + k];
+        x.v[i] = w;
+    }
+    // 2^256 / p < 6
+    for (int k = 0; k < 5; k++) bn254_fr_reduce_once(x.v);
+    bn254_fr r2;
+    memcpy(r2.v, BN254_FR_R2, sizeof(r2.v));
+    bn254_fr_mul(r, &x, &r2);
+}
+
+static inline void bn254_fr_from_u64(bn254_fr *r, uint64_t v) {
+    bn254_fr x = {{v, 0, 0, 0}};
+    bn254_fr r2;
+    memcpy(r2.v, BN254_FR_R2, sizeof(r2.v));
+    bn254_fr_mul(r, &x, &r2);
+}
+
+// 输出规范值的 32 字节大端表示
+static inline void bn254_fr_to_bytes(const bn254_fr *a, uint8_t *out) {
+    bn254_fr one = {{1, 0, 0, 0}};
+    bn254_fr x;
+    bn254_fr_mul(&x, a, &one);
+    for (int i = 0; i < 4; i++) {
+        for (int k = 0; k < 8; k++) out[(3 - i) * 8 + k] = (uint8_t) (x.v[i] >> (56 - 8 * k));
+    }
+}
+
+// --- Poseidon2 置换 ---
+
+#define POSEIDON2_T2_FULL_ROUNDS 8
+#define POSEIDON2_T2_PARTIAL_ROUNDS 56
+
+// 轮常数，以 Montgomery 形式存放。规范值由 Grain LFSR（域 1，S 盒 0，n = 254，t = 2，R_F = 8，R_P = 56）
+// 按参考实现的顺序生成：完整轮每轮 2 个，部分轮每轮 1 个；首个常数的规范值为
+// 0x09c46e9ec68e9bd4fe1faaba294cba38a71aa177534cdd1b6c7dc0dbd0abd7a7
+static const uint64_t POSEIDON2_T2_RC[POSEIDON2_T2_FULL_ROUNDS * 2 + POSEIDON2_T2_PARTIAL_ROUNDS][4] = {
+        // 前 4 个完整轮
+        {0xa96c453dc58aca67, 0x73eb0f4319a6fa1b, 0xc1584c4902cfebe6, 0x0258feaeab003c81},
+        {0x999f128f883214ee, 0x3812d56244476181, 0xf1c713591a60e735, 0x1d29e209ed432b39},
+        {0x10245a461f9886f9, 0xc1f6a382a4af9cd7, 0x43dc54de7be4216c, 0x08dde7787782a71d},
+        {0x86d4b4dfcfcc4182, 0xb39eadc24bb31793, 0xf2eb1492aa7b0c79, 0x14adb8ab12efc7fc},
+        {0x5ac9777b239d7f99, 0x2de9df1a6b10a565, 0x0fbbf650052bad6b, 0x1d9e1fcdfdd4cd35},
+        {0x610101865edf14ab, 0x10cc90a9e968ec10, 0xbc3715a205fc111a, 0x2f07f1e20f67d489},
+        {0xd1b7a8a6f159c12e, 0x36243b2a680a4228, 0x20d439cec6a8e4a8, 0x228c467513fc8cef},
+        {0xd78a36ba6e65a009, 0x27b2c19d400613f7, 0xb3eba82561a94f58, 0x1a07ef8d266420ad},
+        // 56 个部分轮，每轮只加到 state[0]
+        {0x8099c7d930553dfe, 0x87c661d6077c15b7, 0x5a5ac36a76bd32d3, 0x27889e1d793f840c},
+        {0x29388f35439e8c4b, 0x42a07b4da45f0bbb, 0x411b6d19b6611e22, 0x0a6d920746a04c15},
+        {0x2d7e1c1027534ec9, 0xd55601d295ff74c4, 0xb43d00710721d217, 0x012686ab8ae93cd2},
+        {0xa489be9a31841db1, 0xcfe42b63851ee28b, 0x78a78fff698a5272, 0x156e33ea2de332a2},
+        {0x2b52a7172d84bd84, 0xc37eac07823d04f8, 0x2dd4d10602284e03, 0x291941dd0ceea4f1},
+        {0x2d132ca948aa3564, 0x0d69b2b0a0f323c9, 0xbd135b98e5ac170c, 0x2eb17bec78df7294},
+        {0xb27b508ae5174737, 0xed83bd8e6f1891b5, 0x9fff519abdc159b6, 0x18accd26da500d5c},
+        {0x72f41170e9789115, 0x97b50e3d46c3b143, 0xd3a82a78be4cd18e, 0x0d135f73a0b59e10},
+        {0xf8f813168475e2d7, 0xac8729148900dd99, 0x47c245f73ad542b9, 0x0d4eaa0cc86c4bc5},
+        {0xf0eb00af61b508a8, 0x1d8ef8cd804e5816, 0xff7ddf4367629878, 0x2bca06cf8ed0ac37},
+        {0xca6ad2283d19de16, 0x44bac763338950e6, 0xb9d829d89c4ff430, 0x1c59e2d366b057de},
+        {0x6893946bd9d1bed1, 0x5194597e219e8861, 0xcfb879490d8ae06b, 0x2067c27e7817da48},
+        {0xe1d516357166ba33, 0xb7d9765678be6da4, 0xede788ac21265799, 0x301ec35d6c040fbf},
+        {0x10869851c117a901, 0xe3b9a765195dc3f7, 0x4c6cdbd3e4c5cf3e, 0x1dbfee289a219d25},
+        {0xc27e269170bbd4ca, 0xb2699884b935068d, 0x85d09b6f47461a9a, 0x0765e3eb4ee29d1a},
+        {0xb80972bc0a3d4a9a, 0x6a95e82385221a89, 0x29de2e17845075b1, 0x2e0bac69061e5aa4},
+        {0xd9dc3367c6c215d2, 0x2aa49878b5b9449e, 0xc2b96cf438cc73ec, 0x0f8ffda334845f74},
+        {0x9ea9a08f13bc2971, 0x9e6b7a1b24884e5b, 0xa5ec85eb1e6cb18f, 0x2e381f3cbe57c88d},
+        {0xcf6f0f63166dc32e, 0xb111cc4db3db063b, 0x6c58727ffe90a1d7, 0x05e624ff82e2b944},
+        {0x595827549e31edb7, 0xd3bde7cf17abef70, 0xfac533a72d527a24, 0x060ece5235787b72},
+        {0x30d8f27f0080a33d, 0x691103220aa85284, 0x3c11003092bf61d2, 0x1342a4cfd901a295},
+        {0x61b87beb719426c1, 0x34ba95d60eb9ebbd, 0xee6280441a829247, 0x23fad23a17da49d5},
+        {0x2d5671a0fac38f4c, 0xbba9fcc1c1b1a449, 0x4da9096bfaaf9c19, 0x05b4ec45dc045007},
+        {0x037436a1aa8c7f8c, 0x18b3bf03001c7301, 0xde9a6fc8b7e5a635, 0x1869c170d9259cb6},
+        {0xf72c49c01bc31bd6, 0x195c10b2304e1f0c, 0x15f734f15b8fdbeb, 0x0d3c0e250d2020fe},
+        {0x0fcff73552b2e2d9, 0xd0414e687c4850d5, 0x00744ae01cd04142, 0x1619ea74ff1794c1},
+        {0x28500b6a73d405b7, 0xb4c2f96ac4fb355a, 0x1dc6a7f3394d3d12, 0x156e721c51da53c9},
+        {0x5e3d132739468327, 0xf372b54e51b2722d, 0x9b29355985fe2518, 0x17a81a0bc574d844},
+        {0x176a569a42051a56, 0xaf6a331b261f3277, 0xe08d06ec2b469f7e, 0x1662a55b8a8c2cbf},
+        {0x3bc085dedf786323, 0x178e5df39e4fd5fa, 0x98f7befec8dd5467, 0x1374c3f62b7cd78b},
+        {0x9c93097b9ed507f4, 0x0e7691672a42fe66, 0x13c16032896a115e, 0x1eda5a3d1db230bc},
+        {0x36a3664797689721, 0xd83062984cb25e9f, 0xeb62da57ead47c18, 0x240c42cb8898c9de},
+        {0x6ef4b4e511843d3d, 0xca8edb3ecb6ee554, 0x6ebd407bb39e22ff, 0x2bf5eb2db5c78e6e},
+        {0xfd07c7c3ec0aa2c6, 0xb5eecf9dcaae86c9, 0xa345338900c1ac8b, 0x00d3ab5b3cee349c},
+        {0x25c0667f20608a97, 0xd7de20ae5011ca43, 0x3bc6c7aff1f021c3, 0x2f14c8114561b4b6},
+        {0x5b1bfc0f8c8a6097, 0x79f9b35d24ba2022, 0x7da661b039ed6645, 0x05aa835dfd00eedb},
+        {0x6e690c1c90403aff, 0x55e412a440b9cff8, 0xbb7ea2b4af3e4cd7, 0x00568e83d40efc8d},
+        {0x43af3e266373b671, 0x127f969e3f3814e7, 0x2a75164a578e552c, 0x2175fac47f74fffe},
+        {0xeb4c476d65ea944d, 0xe947cd8484aa5664, 0x260b6908aeadc54a, 0x025e4f0ca5d6b0b8},
+        {0xb2bb86f30f8ef8b3, 0x503e0262637bdf9e, 0xf45a8a04de2f07bb, 0x22a549157c02d6e8},
+        {0xb7720222d9a506b9, 0x8b03d26c07561bc7, 0x0c997d272bcc0fcb, 0x214bec2670b36742},
+        {0x6db0ef8b7577bb86, 0xd487ffebe2bdef59, 0x8fccdcdab81b9491, 0x0d2c4e919b4e9067},
+        {0xbc373e8cf5a00e6b, 0xca5f9450feacdb15, 0xf02e25111abf5533, 0x2eda54e9fc8ef2e1},
+        {0x54a9f39c28361dde, 0x43f7f6c28e9bd7d4, 0xd5a7772607458591, 0x1a88852df6658bf2},
+        {0x9667b08e4e0129b2, 0x1b82df4fbc2802e0, 0x2667926acfa6d069, 0x0ef12dac48270df6},
+        {0x099e78a54b060dd6, 0x941beb22cff80798, 0x01f6da3b766400e2, 0x0ad1ca2c2e4d9c93},
+        {0xf20c0e76519dd82c, 0x5dd02cdfd2ac3c96, 0xe391867f83ae55d4, 0x30068131c4fe95d1},
+        {0x4dc7005ff1f30413, 0xcdb270162845cfbb, 0xe161cc2901758391, 0x093f1cff3bbac7d4},
+        {0x3a82a99f7d37e7ca, 0x86ca9972a31b215f, 0xe0508aa7e0e12531, 0x2b21602b9c0ab846},
+        {0xc8e755540a0959c2, 0x1c7873e82d6c91f9, 0x1fb10bb098913a15, 0x2bd2e3bee55bc94e},
+        {0xa8cc4d5980fba8a1, 0x738008832215497d, 0xcb613bd535c93170, 0x1928e9ed1a2fe728},
+        {0x4792d3a4b7086125, 0xd6fca8f840d3912b, 0x157c8bf89713a132, 0x2ddbc6bdd197a327},
+        {0xf658ea6e8ce21945, 0x9f8edc049bdf695f, 0x334a7227b37ffe84, 0x03aa0ace0b3934d8},
+        {0x3be0c64e6178fc72, 0x8258af153376a5a5, 0x01bbc50c72632835, 0x05c5c5f078461126},
+        {0xca5ca78d5ceb88c8, 0xd58ccd5f3af51ead, 0xac6f13a94ff64d28, 0x2571325d7770d676},
+        {0x227f5268901865aa, 0xbf1d22d3298454de, 0x7a477e52e2de015f, 0x2a8bf714ae1dc826},
+        // 后 4 个完整轮
+        {0xabe800c56c03f53f, 0x99a08bbfe62a8eb9, 0x858e0814814b855b, 0x17a98d6f0420500a},
+        {0x2452da7b2cf0b07f, 0xa1dff84a6c89a4ee, 0xec02277ada8f2e3b, 0x209688255f5ce1d5},
+        {0xe16ec3401066f7c6, 0x52123b4dd78c72f3, 0xfc415ba388773994, 0x0bab3f3f454240a6},
+        {0x6e9ebc16180a3588, 0x30117fc8c4d6f90b, 0xda57687662607c64, 0x04b4939350e75c9a},
+        {0x9b9f8362205afd38, 0xaeeae293cc4f42b9, 0x71501b1659929038, 0x0a3f23046ae6a2d7},
+        {0xd6ed03ca90af264a, 0xcf5c0afcafac7d63, 0x8a4de575cb0936e8, 0x15c15d2fe6f3e596},
+        {0xd0fbe11de3480394, 0xe1be34783fa42cd2, 0x93319f25b5a6722a, 0x1869731f363e9dd7},
+        {0x58588f426e2e4b8d, 0x7782f8ee21b7db86, 0xb09873d755316d82, 0x062c9c115f1756fc}
+};
+
+static inline void poseidon2_sbox(bn254_fr *x) {
+    bn254_fr x2, x4;
+    bn254_fr_mul(&x2, x, x);
+    bn254_fr_mul(&x4, &x2, &x2);
+    bn254_fr_mul(x, &x4, x);
+}
+
+// 外部线性层 [[2, 1], [1, 2]]
+static inline void poseidon2_t2_external(bn254_fr *s) {
+    bn254_fr sum;
+    bn254_fr_add(&sum, &s[0], &s[1]);
+    bn254_fr_add(&s[0], &s[0], &sum);
+    bn254_fr_add(&s[1], &s[1], &sum);
+}
+
+// 内部线性层 [[2, 1], [1, 3]]
+static inline void poseidon2_t2_internal(bn254_fr *s) {
+    bn254_fr sum;
+    bn254_fr_add(&sum, &s[0], &s[1]);
+    bn254_fr_add(&s[0], &s[0], &sum);
+    bn254_fr_add(&s[1], &s[1], &s[1]);
+    bn254_fr_add(&s[1], &s[1], &sum);
+}
+
+static inline void poseidon2_t2_full_round(bn254_fr *s, const uint64_t (*rc)[4]) {
+    for (int i = 0; i < 2; i++) {
+        bn254_fr c;
+        memcpy(c.v, rc[i], sizeof(c.v));
+        bn254_fr_add(&s[i], &s[i], &c);
+        poseidon2_sbox(&s[i]);
+    }
+    poseidon2_t2_external(s);
+}
+
+static inline void poseidon2_t2_permute(bn254_fr *s) {
+    const uint64_t (*rc)[4] = POSEIDON2_T2_RC;
+    poseidon2_t2_external(s);
+    for (int r = 0; r < POSEIDON2_T2_FULL_ROUNDS / 2; r++, rc += 2) {
+        poseidon2_t2_full_round(s, rc);
+    }
+    for (int r = 0; r < POSEIDON2_T2_PARTIAL_ROUNDS; r++, rc++) {
+        bn254_fr c;
+        memcpy(c.v, rc[0], sizeof(c.v));
+        bn254_fr_add(&s[0], &s[0], &c);
+        poseidon2_sbox(&s[0]);
+        poseidon2_t2_internal(s);
+    }
+    for (int r = 0; r < POSEIDON2_T2_FULL_ROUNDS / 2; r++, rc += 2) {
+        poseidon2_t2_full_round(s, rc);
+    }
+}
+
+#endif
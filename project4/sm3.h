@@ -0,0 +1,414 @@
+#ifndef SM3_H
+#define SM3_H
+
+// SM3 公共实现：压缩函数取自 sm3_better.cpp，
+// 在其上增加按字节处理的流式接口（init/update/final），
+// 并允许从任意链接变量（中间状态）继续计算，供 HMAC、KDF 等复用。
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SM3_BLOCK_SIZE 64
+#define SM3_DIGEST_SIZE 32
+
+static const uint32_t SM3_IV[8] = {
+        0x7380166f, 0x4914b2b9, 0x172442d7, 0xda8a0600,
+        0xa96f30bc, 0x163138aa, 0xe38dee4d, 0xb0fb0e4e
+};
+
+static inline uint32_t sm3_Tj(uint8_t j) {
+    if (j < 16)
+        return 0x79cc4519;
+    return 0x7a879d8a;
+}
+
+static inline uint32_t sm3_FF(uint32_t X, uint32_t Y, uint32_t Z, uint8_t j) {
+    if (j < 16)
+        return X ^ Y ^ Z;
+    return (X & Y) | (X & Z) | (Y & Z);
+}
+
+static inline uint32_t sm3_GG(uint32_t X, uint32_t Y, uint32_t Z, uint8_t j) {
+    if (j < 16)
+        return X ^ Y ^ Z;
+    return (X & Y) | ((~X) & Z);
+}
+
+// 循环左移，k 为 0 时避免移位 32 位的未定义行为
+static inline uint32_t sm3_RL(uint32_t a, uint8_t k) {
+    k &= 31;
+    return (a << k) | (a >> ((32 - k) & 31));
+}
+
+static inline uint32_t sm3_P0(uint32_t X) {
+    return X ^ (sm3_RL(X, 9)) ^ (sm3_RL(X, 17));
+}
+
+static inline uint32_t sm3_P1(uint32_t X) {
+    return X ^ (sm3_RL(X, 15)) ^ (sm3_RL(X, 23));
+}
+
+// 消息扩展：由 16 个字的分组生成 W[68] 和 W'[64]
+static inline void sm3_expand(const uint32_t *block, uint32_t *Wj0, uint32_t *Wj1) {
+    uint8_t i;
+    for (i = 0; i < 16; i++) {
+        Wj0[i] = block[i];
+    }
+    for (i = 16; i < 68; i++) {
+        Wj0[i] = sm3_P1(Wj0[i - 16] ^ Wj0[i - 9] ^ sm3_RL(Wj0[i - 3], 15)) ^ sm3_RL(Wj0[i - 13], 7) ^ Wj0[i - 6];
+    }
+    for (i = 0; i < 64; i++) {
+        Wj1[i] = Wj0[i] ^ Wj0[i + 4];
+    }
+}
+
+// 用已扩展好的消息字做 64 轮迭代并更新链接变量
+static inline void sm3_compress_expanded(uint32_t *hash, const uint32_t *Wj0, const uint32_t *Wj1) {
+    uint32_t A = hash[0], B = hash[1], C = hash[2], D = hash[3];
+    uint32_t E = hash[4], F = hash[5], G = hash[6], H = hash[7];
+    uint32_t SS1, SS2, TT1, TT2;
+    uint8_t j;
+
+    for (j = 0; j < 64; j++) {
+        SS1 = sm3_RL(sm3_RL(A, 12) + E + sm3_RL(sm3_Tj(j), j), 7);
+        SS2 = SS1 ^ (sm3_RL(A, 12));
+        TT1 = sm3_FF(A, B, C, j) + D + SS2 + Wj1[j];
+        TT2 = sm3_GG(E, F, G, j) + H + SS1 + Wj0[j];
+        D = C;
+        C = sm3_RL(B, 9);
+        B = A;
+        A = TT1;
+        H = G;
+        G = sm3_RL(F, 19);
+        F = E;
+        E = sm3_P0(TT2);
+    }
+
+    hash[0] = (A ^ hash[0]);
+    hash[1] = (B ^ hash[1]);
+    hash[2] = (C ^ hash[2]);
+    hash[3] = (D ^ hash[3]);
+    hash[4] = (E ^ hash[4]);
+    hash[5] = (F ^ hash[5]);
+    hash[6] = (G ^ hash[6]);
+    hash[7] = (H ^ hash[7]);
+}
+
+// 压缩一个分组，block 为 16 个已按大端序解释好的字
+static inline void sm3_one_block(uint32_t *hash, const uint32_t *block) {
+    uint32_t Wj0[68];
+    uint32_t Wj1[64];
+    sm3_expand(block, Wj0, Wj1);
+    sm3_compress_expanded(hash, Wj0, Wj1);
+}
+
+// --- 字节序辅助函数 ---
+
+static inline uint32_t sm3_load_be32(const uint8_t *p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static inline void sm3_store_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+static inline uint64_t sm3_load_be64(const uint8_t *p) {
+    return ((uint64_t) sm3_load_be32(p) << 32) | sm3_load_be32(p + 4);
+}
+
+static inline void sm3_store_be64(uint8_t *p, uint64_t v) {
+    sm3_store_be32(p, (uint32_t) (v >> 32));
+    sm3_store_be32(p + 4, (uint32_t) v);
+}
+
+// 压缩一个 64 字节的字节分组
+static inline void sm3_compress_bytes(uint32_t *hash, const uint8_t *data) {
+    uint32_t block[16];
+    for (int i = 0; i < 16; i++) {
+        block[i] = sm3_load_be32(data + 4 * i);
+    }
+    sm3_one_block(hash, block);
+}
+
+static inline void sm3_hash_to_bytes(const uint32_t *hash, uint8_t *out) {
+    for (int i = 0; i < 8; i++) {
+        sm3_store_be32(out + 4 * i, hash[i]);
+    }
+}
+
+// --- 流式接口 ---
+
+typedef struct {
+    uint32_t digest[8];                 // 当前链接变量
+    uint8_t block[SM3_BLOCK_SIZE];      // 未满一个分组的缓存数据
+    uint32_t num;                       // block 中已缓存的字节数
+    uint64_t nblocks;                   // 已压缩的分组数
+} sm3_ctx;
+
+// 从中间状态继续：iv 为已压缩 nblocks 个分组后的链接变量
+static inline void sm3_init_from(sm3_ctx *ctx, const uint32_t *iv, uint64_t nblocks) {
+    memcpy(ctx->digest, iv, sizeof(ctx->digest));
+    ctx->num = 0;
+    ctx->nblocks = nblocks;
+}
+
+static inline void sm3_init(sm3_ctx *ctx) {
+    sm3_init_from(ctx, SM3_IV, 0);
+}
+
+static inline void sm3_update(sm3_ctx *ctx, const uint8_t *data, size_t len) {
+    if (ctx->num) {
+        size_t left = SM3_BLOCK_SIZE - ctx->num;
+        if (len < left) {
+            memcpy(ctx->block + ctx->num, data, len);
+            ctx->num += (uint32_t) len;
+            return;
+        }
+        memcpy(ctx->block + ctx->num, data, left);
+        sm3_compress_bytes(ctx->digest, ctx->block);
+        ctx->nblocks++;
+        data += left;
+        len -= left;
+    }
+    while (len >= SM3_BLOCK_SIZE) {
+        sm3_compress_bytes(ctx->digest, data);
+        ctx->nblocks++;
+        data += SM3_BLOCK_SIZE;
+        len -= SM3_BLOCK_SIZE;
+    }
+    ctx->num = (uint32_t) len;
+    if (len) {
+        memcpy(ctx->block, data, len);
+    }
+}
+
+static inline void sm3_final(sm3_ctx *ctx, uint8_t *out) {
+    uint64_t bit_len = (ctx->nblocks * SM3_BLOCK_SIZE + ctx->num) << 3;
+    ctx->block[ctx->num] = 0x80;
+    if (ctx->num + 9 <= SM3_BLOCK_SIZE) {
+        memset(ctx->block + ctx->num + 1, 0, SM3_BLOCK_SIZE - ctx->num - 9);
+    } else {
+        memset(ctx->block + ctx->num + 1, 0, SM3_BLOCK_SIZE - ctx->num - 1);
+        sm3_compress_bytes(ctx->digest, ctx->block);
+        memset(ctx->block, 0, SM3_BLOCK_SIZE - 8);
+    }
+    sm3_store_be64(ctx->block + SM3_BLOCK_SIZE - 8, bit_len);
+    sm3_compress_bytes(ctx->digest, ctx->block);
+    sm3_hash_to_bytes(ctx->digest, out);
+}
+
+// 一次性计算 SM3(data)
+static inline void sm3_digest(const uint8_t *data, size_t len, uint8_t *out) {
+    sm3_ctx ctx;
+    sm3_init(&ctx);
+    sm3_update(&ctx, data, len);
+    sm3_final(&ctx, out);
+}
+
+// --- 中间状态的序列化 ---
+// 格式（大端序）：
+//   "SM3S"(4) | 版本(1) | 已处理总字节数(8) | 链接变量(32) | 缓存尾部(总字节数 % 64) | 校验(4)
+// 校验为前面所有字节的 SM3 摘要前 4 字节，用于发现损坏的检查点。
+
+#define SM3_STATE_VERSION 1
+#define SM3_STATE_HEADER_SIZE (4 + 1 + 8 + SM3_DIGEST_SIZE)
+#define SM3_STATE_MAX_SIZE (SM3_STATE_HEADER_SIZE + SM3_BLOCK_SIZE - 1 + 4)
+
+static const uint8_t SM3_STATE_MAGIC[4] = {'S', 'M', '3', 'S'};
+
+// 导出状态，out 至少 SM3_STATE_MAX_SIZE 字节，返回写入的字节数
+static inline size_t sm3_state_export(const sm3_ctx *ctx, uint8_t *out) {
+    uint8_t check[SM3_DIGEST_SIZE];
+    size_t pos = 0;
+    memcpy(out, SM3_STATE_MAGIC, 4);
+    pos += 4;
+    out[pos++] = SM3_STATE_VERSION;
+    sm3_store_be64(out + pos, ctx->nblocks * SM3_BLOCK_SIZE + ctx->num);
+    pos += 8;
+    sm3_hash_to_bytes(ctx->digest, out + pos);
+    pos += SM3_DIGEST_SIZE;
+    memcpy(out + pos, ctx->block, ctx->num);
+    pos += ctx->num;
+    sm3_digest(out, pos, check);
+    memcpy(out + pos, check, 4);
+    return pos + 4;
+}
+
+// 导入状态，成功返回 0；格式、版本、长度或校验不符返回 -1
+static inline int sm3_state_import(sm3_ctx *ctx, const uint8_t *in, size_t len) {
+    uint8_t check[SM3_DIGEST_SIZE];
+    if (len < SM3_STATE_HEADER_SIZE + 4) return -1;
+    if (memcmp(in, SM3_STATE_MAGIC, 4) != 0) return -1;
+    if (in[4] != SM3_STATE_VERSION) return -1;
+
+    uint64_t total = sm3_load_be64(in + 5);
+    // SM3 的消息长度字段为 64 比特，总字节数必须小于 2^61
+    if (total >> 61) return -1;
+    uint32_t num = (uint32_t) (total % SM3_BLOCK_SIZE);
+    if (len != SM3_STATE_HEADER_SIZE + num + 4) return -1;
+
+    sm3_digest(in, len - 4, check);
+    if (memcmp(check, in + len - 4, 4) != 0) return -1;
+
+    for (int i = 0; i < 8; i++) {
+        ctx->digest[i] = sm3_load_be32(in + 13 + 4 * i);
+    }
+    ctx->nblocks = total / SM3_BLOCK_SIZE;
+    ctx->num = num;
+    memcpy(ctx->block, in + SM3_STATE_HEADER_SIZE, num);
+    return 0;
+}
+
+// --- 8 路并行（多缓冲）SM3 ---
+// 需要 AVX2（编译时加 -mavx2 或 -march=native）：8 个互不相关的消息各占一个 32 位通道，
+// 一条指令同时完成 8 个分组的同一步计算。未启用 AVX2 时不定义 SM3_HAVE_X8，调用方使用单路实现。
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+#define SM3_HAVE_X8 1
+#define SM3_X8_LANES 8
+
+typedef struct {
+    __m256i v[8];       // v[k] 的第 i 个通道为第 i 条消息链接变量的第 k 个字
+} sm3_x8_state;
+
+#define SM3_X8_RL(x, k) _mm256_or_si256(_mm256_slli_epi32((x), (k)), _mm256_srli_epi32((x), 32 - (k)))
+
+static inline __m256i sm3_x8_P0(__m256i x) {
+    return _mm256_xor_si256(x, _mm256_xor_si256(SM3_X8_RL(x, 9), SM3_X8_RL(x, 17)));
+}
+
+static inline __m256i sm3_x8_P1(__m256i x) {
+    return _mm256_xor_si256(x, _mm256_xor_si256(SM3_X8_RL(x, 15), SM3_X8_RL(x, 23)));
+}
+
+// 所有通道从同一个链接变量开始
+static inline void sm3_x8_init_from(sm3_x8_state *st, const uint32_t *iv) {
+    for (int k = 0; k < 8; k++) {
+        st->v[k] = _mm256_set1_epi32((int) iv[k]);
+    }
+}
+
+static inline void sm3_x8_init(sm3_x8_state *st) {
+    sm3_x8_init_from(st, SM3_IV);
+}
+
+// 每个通道压缩各自的一个 64 字节分组
+static inline void sm3_x8_compress(sm3_x8_state *st, const uint8_t *const blocks[SM3_X8_LANES]) {
+    static const uint32_t T_ROT[64] = {
+            0x79cc4519, 0xf3988a32, 0xe7311465, 0xce6228cb, 0x9cc45197, 0x3988a32f, 0x7311465e, 0xe6228cbc,
+            0xcc451979, 0x988a32f3, 0x311465e7, 0x6228cbce, 0xc451979c, 0x88a32f39, 0x11465e73, 0x228cbce6,
+            0x9d8a7a87, 0x3b14f50f, 0x7629ea1e, 0xec53d43c, 0xd8a7a879, 0xb14f50f3, 0x629ea1e7, 0xc53d43ce,
+            0x8a7a879d, 0x14f50f3b, 0x29ea1e76, 0x53d43cec, 0xa7a879d8, 0x4f50f3b1, 0x9ea1e762, 0x3d43cec5,
+            0x7a879d8a, 0xf50f3b14, 0xea1e7629, 0xd43cec53, 0xa879d8a7, 0x50f3b14f, 0xa1e7629e, 0x43cec53d,
+            0x879d8a7a, 0x0f3b14f5, 0x1e7629ea, 0x3cec53d4, 0x79d8a7a8, 0xf3b14f50, 0xe7629ea1, 0xcec53d43,
+            0x9d8a7a87, 0x3b14f50f, 0x7629ea1e, 0xec53d43c, 0xd8a7a879, 0xb14f50f3, 0x629ea1e7, 0xc53d43ce,
+            0x8a7a879d, 0x14f50f3b, 0x29ea1e76, 0x53d43cec, 0xa7a879d8, 0x4f50f3b1, 0x9ea1e762, 0x3d43cec5
+    };
+    // 按字节翻转每个 32 位字（小端加载后转为大端）
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i W[68];
+    uint8_t i, j;
+
+    // 转置：W[k] 的第 i 个通道为第 i 个分组的第 k 个字
+    for (i = 0; i < 16; i++) {
+        uint32_t w[SM3_X8_LANES];
+        for (j = 0; j < SM3_X8_LANES; j++) {
+            memcpy(&w[j], blocks[j] + 4 * i, 4);
+        }
+        W[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) w), bswap);
+    }
+    for (i = 16; i < 68; i++) {
+        __m256i t = _mm256_xor_si256(_mm256_xor_si256(W[i - 16], W[i - 9]), SM3_X8_RL(W[i - 3], 15));
+        W[i] = _mm256_xor_si256(_mm256_xor_si256(sm3_x8_P1(t), SM3_X8_RL(W[i - 13], 7)), W[i - 6]);
+    }
+
+    __m256i A = st->v[0], B = st->v[1], C = st->v[2], D = st->v[3];
+    __m256i E = st->v[4], F = st->v[5], G = st->v[6], H = st->v[7];
+    for (j = 0; j < 64; j++) {
+        __m256i A12 = SM3_X8_RL(A, 12);
+        __m256i SS1 = _mm256_add_epi32(_mm256_add_epi32(A12, E), _mm256_set1_epi32((int) T_ROT[j]));
+        SS1 = SM3_X8_RL(SS1, 7);
+        __m256i SS2 = _mm256_xor_si256(SS1, A12);
+        __m256i ff, gg;
+        if (j < 16) {
+            ff = _mm256_xor_si256(_mm256_xor_si256(A, B), C);
+            gg = _mm256_xor_si256(_mm256_xor_si256(E, F), G);
+        } else {
+            ff = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(A, B), _mm256_and_si256(A, C)),
+                                 _mm256_and_si256(B, C));
+            gg = _mm256_or_si256(_mm256_and_si256(E, F), _mm256_andnot_si256(E, G));
+        }
+        __m256i TT1 = _mm256_add_epi32(_mm256_add_epi32(ff, D),
+                                       _mm256_add_epi32(SS2, _mm256_xor_si256(W[j], W[j + 4])));
+        __m256i TT2 = _mm256_add_epi32(_mm256_add_epi32(gg, H), _mm256_add_epi32(SS1, W[j]));
+        D = C;
+        C = SM3_X8_RL(B, 9);
+        B = A;
+        A = TT1;
+        H = G;
+        G = SM3_X8_RL(F, 19);
+        F = E;
+        E = sm3_x8_P0(TT2);
+    }
+
+    st->v[0] = _mm256_xor_si256(A, st->v[0]);
+    st->v[1] = _mm256_xor_si256(B, st->v[1]);
+    st->v[2] = _mm256_xor_si256(C, st->v[2]);
+    st->v[3] = _mm256_xor_si256(D, st->v[3]);
+    st->v[4] = _mm256_xor_si256(E, st->v[4]);
+    st->v[5] = _mm256_xor_si256(F, st->v[5]);
+    st->v[6] = _mm256_xor_si256(G, st->v[6]);
+    st->v[7] = _mm256_xor_si256(H, st->v[7]);
+}
+
+// 取出各通道的摘要（32 字节大端）
+static inline void sm3_x8_final(const sm3_x8_state *st, uint8_t *const outs[SM3_X8_LANES]) {
+    uint32_t w[SM3_X8_LANES];
+    for (int k = 0; k < 8; k++) {
+        _mm256_storeu_si256((__m256i *) w, st->v[k]);
+        for (int i = 0; i < SM3_X8_LANES; i++) {
+            sm3_store_be32(outs[i] + 4 * k, w[i]);
+        }
+    }
+}
+
+// 同时计算 8 条等长消息的 SM3
+static inline void sm3_digest_x8(const uint8_t *const msgs[SM3_X8_LANES], size_t len,
+                                 uint8_t *const outs[SM3_X8_LANES]) {
+    sm3_x8_state st;
+    const uint8_t *blocks[SM3_X8_LANES];
+    uint8_t tail[SM3_X8_LANES][2 * SM3_BLOCK_SIZE];
+    size_t full = len / SM3_BLOCK_SIZE;
+    size_t rest = len % SM3_BLOCK_SIZE;
+    size_t tail_blocks = (rest + 9 <= SM3_BLOCK_SIZE) ? 1 : 2;
+    int i;
+
+    sm3_x8_init(&st);
+    for (size_t b = 0; b < full; b++) {
+        for (i = 0; i < SM3_X8_LANES; i++) blocks[i] = msgs[i] + b * SM3_BLOCK_SIZE;
+        sm3_x8_compress(&st, blocks);
+    }
+    for (i = 0; i < SM3_X8_LANES; i++) {
+        memset(tail[i], 0, sizeof(tail[i]));
+        memcpy(tail[i], msgs[i] + full * SM3_BLOCK_SIZE, rest);
+        tail[i][rest] = 0x80;
+        sm3_store_be64(tail[i] + tail_blocks * SM3_BLOCK_SIZE - 8, (uint64_t) len << 3);
+    }
+    for (size_t b = 0; b < tail_blocks; b++) {
+        for (i = 0; i < SM3_X8_LANES; i++) blocks[i] = tail[i] + b * SM3_BLOCK_SIZE;
+        sm3_x8_compress(&st, blocks);
+    }
+    sm3_x8_final(&st, outs);
+}
+
+#undef SM3_X8_RL
+#endif
+
+#endif
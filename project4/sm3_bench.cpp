@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <openssl/evp.h>
+#include "sm3.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+// SM3 各实现的差分测试与性能对比
+// 1. 差分测试：0 到 1024 字节的每个长度（覆盖所有 55/56/64 填充边界）以及随机长度（最大 --max-bytes，
+//    默认 1 GiB）的随机消息，所有实现的摘要必须一致，否则返回非零；merkle_tree.cpp 的 65 字节内部节点哈希
+//    （逐个与 8 路）也与 sm3.h、OpenSSL 逐一比较；
+// 2. 性能：长消息 cycles/byte、短消息延迟、多线程扩展性，以 JSON 输出到标准输出。
+//
+// 编译: g++ -O2 -mavx2 -pthread sm3_bench.cpp -o sm3_bench -lcrypto（不加 -mavx2 时跳过 8 路并行内核）
+// 用法: ./sm3_bench [--max-bytes N] [--random N] [--seed S] [--threads T]
+
+// 原有的两个实现各自带 main，放进命名空间并改名后直接包含进来
+#define main sm3_cpp_main
+namespace sm3_ref {
+#include "sm3.cpp"
+}
+#undef main
+#define main sm3_better_cpp_main
+namespace sm3_better {
+#include "sm3_better.cpp"
+}
+#undef main
+// merkle_tree.cpp 的内部节点哈希（预计算消息扩展的 sm3_hash_node 与 8 路的 sm3_hash_nodes_x8 /
+// sm3_hash_prefixed_x8），同样改名 main 后包含进来
+#define main merkle_tree_main
+#include "merkle_tree.cpp"
+#undef main
+
+typedef void (*sm3_impl_fn)(const uint8_t *data, size_t len, uint8_t *out);
+
+// sm3.cpp / sm3_better.cpp 的输入是按大端解释好的字数组，需要先转换
+static std::vector<uint32_t> to_words(const uint8_t *data, size_t len) {
+    std::vector<uint32_t> words((len + 3) / 4 + 1, 0);
+    for (size_t i = 0; i < len; i++) {
+        words[i / 4] |= (uint32_t) data[i] << (24 - 8 * (i % 4));
+    }
+    return words;
+}
+
+// 字数组已准备好时调用，性能测试时不计入转换开销
+static thread_local std::vector<uint32_t> tls_words;
+
+static void prepare_words(const uint8_t *data, size_t len) {
+    tls_words = to_words(data, len);
+}
+
+static void run_sm3_ref(const uint8_t *, size_t len, uint8_t *out) {
+    uint32_t hash[8];
+    sm3_ref::sm3_get_hash(tls_words.data(), hash, (uint32_t) len);
+    sm3_hash_to_bytes(hash, out);
+}
+
+static void run_sm3_better(const uint8_t *, size_t len, uint8_t *out) {
+    uint32_t hash[8];
+    sm3_better::sm3_get_hash(tls_words.data(), hash, (uint32_t) len);
+    sm3_hash_to_bytes(hash, out);
+}
+
+// 与 merkle_tree.cpp 中 sm3_hash 相同的 OpenSSL EVP 调用路径
+static void run_openssl_evp(const uint8_t *data, size_t len, uint8_t *out) {
+    static thread_local EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    static const EVP_MD *md = EVP_get_digestbyname("SM3");
+    unsigned int out_len = 0;
+    EVP_DigestInit_ex(mdctx, md, NULL);
+    EVP_DigestUpdate(mdctx, data, len);
+    EVP_DigestFinal_ex(mdctx, out, &out_len);
+}
+
+static void run_sm3_h(const uint8_t *data, size_t len, uint8_t *out) {
+    sm3_digest(data, len, out);
+}
+
+// 以不规则的分段调用 sm3_update，检验流式接口的缓存逻辑
+static void run_sm3_h_chunked(const uint8_t *data, size_t len, uint8_t *out) {
+    static const size_t chunks[] = {1, 63, 7, 64, 65, 3, 128, 55, 4096};
+    sm3_ctx ctx;
+    sm3_init(&ctx);
+    size_t pos = 0, k = 0;
+    while (pos < len) {
+        size_t n = chunks[k++ % (sizeof(chunks) / sizeof(chunks[0]))];
+        if (n > len - pos) n = len - pos;
+        sm3_update(&ctx, data + pos, n);
+        pos += n;
+    }
+    sm3_final(&ctx, out);
+}
+
+#ifdef SM3_HAVE_X8
+// 8 路并行内核：8 个通道处理同一消息，各通道结果必须一致；吞吐按 8 条消息计
+static void run_sm3_x8(const uint8_t *data, size_t len, uint8_t *out) {
+    uint8_t lanes[SM3_X8_LANES][SM3_DIGEST_SIZE];
+    const uint8_t *msgs[SM3_X8_LANES];
+    uint8_t *outs[SM3_X8_LANES];
+    for (int i = 0; i < SM3_X8_LANES; i++) {
+        msgs[i] = data;
+        outs[i] = lanes[i];
+    }
+    sm3_digest_x8(msgs, len, outs);
+    memcpy(out, lanes[0], SM3_DIGEST_SIZE);
+    for (int i = 1; i < SM3_X8_LANES; i++) {
+        if (memcmp(lanes[i], lanes[0], SM3_DIGEST_SIZE) != 0) {
+            memset(out, 0, SM3_DIGEST_SIZE);
+        }
+    }
+}
+#endif
+
+struct Sm3Impl {
+    const char *name;
+    sm3_impl_fn fn;
+    bool needs_words;       // 输入需要先转换为字数组
+    int lanes;              // 每次调用实际处理的消息条数
+};
+
+// 新的 SM3 内核在这里登记即可参与差分测试和性能对比
+static const Sm3Impl IMPLS[] = {
+        {"sm3.cpp",          run_sm3_ref,       true,  1},
+        {"sm3_better.cpp",   run_sm3_better,    true,  1},
+        {"openssl_evp",      run_openssl_evp,   false, 1},
+        {"sm3.h",            run_sm3_h,         false, 1},
+        {"sm3.h_chunked",    run_sm3_h_chunked, false, 1},
+#ifdef SM3_HAVE_X8
+        {"sm3.h_x8",         run_sm3_x8,        false, SM3_X8_LANES},
+#endif
+};
+static const size_t IMPL_COUNT = sizeof(IMPLS) / sizeof(IMPLS[0]);
+
+static uint64_t read_cycles() {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static double now_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void fill_random(std::mt19937_64 &rng, uint8_t *buf, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v = rng();
+        memcpy(buf + i, &v, 8);
+    }
+    uint64_t v = rng();
+    memcpy(buf + i, &v, len - i);
+}
+
+// --- 差分测试 ---
+
+static bool check_one(const uint8_t *data, size_t len) {
+    uint8_t expect[SM3_DIGEST_SIZE];
+    uint8_t got[SM3_DIGEST_SIZE];
+    bool ok = true;
+    prepare_words(data, len);
+    IMPLS[0].fn(data, len, expect);
+    for (size_t i = 1; i < IMPL_COUNT; i++) {
+        IMPLS[i].fn(data, len, got);
+        if (memcmp(expect, got, SM3_DIGEST_SIZE) != 0) {
+            fprintf(stderr, "摘要不一致: len=%zu, %s vs %s\n", len, IMPLS[0].name, IMPLS[i].name);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool differential_test(std::mt19937_64 &rng, std::vector<uint8_t> &buf, size_t max_bytes,
+                              size_t random_count, size_t *checked) {
+    bool ok = true;
+    size_t n = 0;
+    // 0..1024 的每个长度，覆盖每个分组的 55/56/64 边界
+    for (size_t len = 0; len <= 1024 && len <= max_bytes; len++, n++) {
+        fill_random(rng, buf.data(), len);
+        ok &= check_one(buf.data(), len);
+    }
+    // 随机长度：按数量级均匀分布，使短消息和长消息都能覆盖到
+    std::uniform_real_distribution<double> log_len(0.0, __builtin_log2((double) max_bytes + 1));
+    for (size_t i = 0; i < random_count; i++, n++) {
+        size_t len = (size_t) __builtin_exp2(log_len(rng)) - 1;
+        if (len > max_bytes) len = max_bytes;
+        fill_random(rng, buf.data(), len);
+        ok &= check_one(buf.data(), len);
+    }
+    // 最大长度本身
+    fill_random(rng, buf.data(), max_bytes);
+    ok &= check_one(buf.data(), max_bytes);
+    *checked = n + 1;
+    return ok;
+}
+
+// --- 内部节点哈希的差分测试 ---
+// 原像固定为 0x01 || left || right（65 字节），sm3_hash_node 按 right[31] 查预计算的消息扩展表，
+// 8 路版本另走 AVX2 内核。每个结果都与 sm3.h 流式接口和 OpenSSL 对同一原像的摘要比较；
+// right[31] 依次取遍 0..255，覆盖查表的全部下标
+
+static bool check_node(const Hash &left, const Hash &right, const Hash &got, const char *name) {
+    uint8_t preimage[1 + 2 * HASH_SIZE];
+    uint8_t expect[SM3_DIGEST_SIZE];
+    uint8_t openssl[SM3_DIGEST_SIZE];
+    preimage[0] = 0x01;
+    memcpy(preimage + 1, left.data(), HASH_SIZE);
+    memcpy(preimage + 1 + HASH_SIZE, right.data(), HASH_SIZE);
+    run_sm3_h(preimage, sizeof(preimage), expect);
+    run_openssl_evp(preimage, sizeof(preimage), openssl);
+    if (memcmp(expect, openssl, SM3_DIGEST_SIZE) != 0 || memcmp(expect, got.data(), SM3_DIGEST_SIZE) != 0) {
+        fprintf(stderr, "内部节点摘要不一致: right[31]=%u, %s vs sm3.h / openssl_evp\n", right[HASH_SIZE - 1], name);
+        return false;
+    }
+    return true;
+}
+
+static bool node_test(std::mt19937_64 &rng, size_t groups, size_t *checked) {
+    bool ok = true;
+    size_t n = 0;
+    for (size_t g = 0; g < groups; g++) {
+        Hash lefts[8], rights[8];
+        for (int k = 0; k < 8; k++) {
+            fill_random(rng, lefts[k].data(), HASH_SIZE);
+            fill_random(rng, rights[k].data(), HASH_SIZE);
+            rights[k][HASH_SIZE - 1] = (uint8_t) (g * 8 + k);
+        }
+        for (int k = 0; k < 8; k++, n++) {
+            ok &= check_node(lefts[k], rights[k], sm3_hash_node(lefts[k], rights[k]), "sm3_hash_node");
+        }
+#ifdef MERKLE_HAVE_X8
+        Hash outs[SM3_X8_LANES];
+        const Hash *left_ptrs[SM3_X8_LANES], *right_ptrs[SM3_X8_LANES];
+        Hash *out_ptrs[SM3_X8_LANES];
+        for (int k = 0; k < SM3_X8_LANES; k++) {
+            left_ptrs[k] = &lefts[k];
+            // 奇数层末尾的节点与自身配对，左右指向同一个摘要
+            right_ptrs[k] = (g % 4 == 3 && k == SM3_X8_LANES - 1) ? &lefts[k] : &rights[k];
+            out_ptrs[k] = &outs[k];
+        }
+        sm3_hash_nodes_x8(left_ptrs, right_ptrs, out_ptrs);
+        for (int k = 0; k < SM3_X8_LANES; k++, n++) {
+            ok &= check_node(lefts[k], *right_ptrs[k], outs[k], "sm3_hash_nodes_x8");
+        }
+        // 通用的 8 路前缀哈希：原像 0x01 || (left || right)，left 与 right 在内存中连续
+        Hash pairs[SM3_X8_LANES][2];
+        std::string_view preimages[SM3_X8_LANES];
+        for (int k = 0; k < SM3_X8_LANES; k++) {
+            pairs[k][0] = lefts[k];
+            pairs[k][1] = rights[k];
+            preimages[k] = std::string_view(reinterpret_cast<const char *>(pairs[k][0].data()), 2 * HASH_SIZE);
+        }
+        sm3_hash_prefixed_x8(0x01, preimages, prefixed_block_count(preimages[0]), out_ptrs);
+        for (int k = 0; k < SM3_X8_LANES; k++, n++) {
+            ok &= check_node(lefts[k], rights[k], outs[k], "sm3_hash_prefixed_x8");
+        }
+#endif
+    }
+    *checked = n;
+    return ok;
+}
+
+// --- 性能测试 ---
+
+struct Throughput {
+    double cycles_per_byte;
+    double mb_per_s;
+};
+
+static Throughput measure_throughput(const Sm3Impl &impl, const uint8_t *data, size_t len) {
+    uint8_t out[SM3_DIGEST_SIZE];
+    if (impl.needs_words) prepare_words(data, len);
+    impl.fn(data, len, out);  // 预热
+    int rounds = 0;
+    uint64_t c0 = read_cycles();
+    double t0 = now_seconds(), t1;
+    do {
+        impl.fn(data, len, out);
+        rounds++;
+        t1 = now_seconds();
+    } while (t1 - t0 < 0.5);
+    uint64_t c1 = read_cycles();
+    double bytes = (double) len * rounds * impl.lanes;
+    return {(double) (c1 - c0) / bytes, bytes / (t1 - t0) / 1e6};
+}
+
+struct Latency {
+    double ns;
+    double cycles;
+};
+
+static Latency measure_latency(const Sm3Impl &impl, const uint8_t *data, size_t len) {
+    uint8_t out[SM3_DIGEST_SIZE];
+    if (impl.needs_words) prepare_words(data, len);
+    const int iters = 100000;
+    for (int i = 0; i < 1000; i++) impl.fn(data, len, out);
+    uint64_t c0 = read_cycles();
+    double t0 = now_seconds();
+    for (int i = 0; i < iters; i++) impl.fn(data, len, out);
+    double t1 = now_seconds();
+    uint64_t c1 = read_cycles();
+    return {(t1 - t0) * 1e9 / iters / impl.lanes, (double) (c1 - c0) / iters / impl.lanes};
+}
+
+// 每个线程独立哈希自己的缓冲区，返回总吞吐 MB/s
+static double measure_scaling(const Sm3Impl &impl, unsigned int threads, size_t len) {
+    std::vector<std::thread> pool;
+    std::vector<double> bytes(threads, 0);
+    double t0 = now_seconds();
+    for (unsigned int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t]() {
+            std::vector<uint8_t> buf(len);
+            std::mt19937_64 rng(t);
+            fill_random(rng, buf.data(), len);
+            uint8_t out[SM3_DIGEST_SIZE];
+            if (impl.needs_words) prepare_words(buf.data(), len);
+            double start = now_seconds();
+            do {
+                impl.fn(buf.data(), len, out);
+                bytes[t] += (double) len * impl.lanes;
+            } while (now_seconds() - start < 0.5);
+        });
+    }
+    for (auto &th : pool) th.join();
+    double t1 = now_seconds();
+    double total = 0;
+    for (double b : bytes) total += b;
+    return total / (t1 - t0) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_bytes = (size_t) 1 << 30;
+    size_t random_count = 200;
+    uint64_t seed = 20250801;
+    unsigned int max_threads = std::thread::hardware_concurrency();
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--max-bytes") == 0) max_bytes = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--random") == 0) random_count = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--seed") == 0) seed = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0) max_threads = (unsigned int) strtoul(argv[i + 1], NULL, 10);
+    }
+    if (max_threads == 0) max_threads = 1;
+    // sm3.cpp / sm3_better.cpp 的长度参数为 32 位
+    if (max_bytes > 0xffffffffu) max_bytes = 0xffffffffu;
+    if (!EVP_get_digestbyname("SM3")) {
+        fprintf(stderr, "SM3 not supported by this OpenSSL version. Use OpenSSL 3.0+\n");
+        return 1;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::vector<uint8_t> buf(max_bytes + 8);
+    size_t checked = 0;
+    bool ok = differential_test(rng, buf, max_bytes, random_count, &checked);
+    fprintf(stderr, "差分测试: %zu 条消息, %s\n", checked, ok ? "全部一致" : "存在不一致");
+    size_t nodes_checked = 0;
+    bool nodes_ok = node_test(rng, 4096, &nodes_checked);
+    fprintf(stderr, "内部节点差分测试: %zu 个节点, %s\n", nodes_checked, nodes_ok ? "全部一致" : "存在不一致");
+    ok &= nodes_ok;
+
+    const size_t long_len = max_bytes < ((size_t) 16 << 20) ? max_bytes : ((size_t) 16 << 20);
+    const size_t short_lens[] = {0, 32, 55, 56, 64, 65, 119, 120, 128};
+    const size_t scaling_len = (size_t) 1 << 20;
+    fill_random(rng, buf.data(), long_len);
+
+    printf("{\n");
+    printf("  \"seed\": %llu,\n", (unsigned long long) seed);
+    printf("  \"differential\": {\"messages\": %zu, \"max_bytes\": %zu, \"nodes\": %zu, \"ok\": %s},\n",
+           checked, max_bytes, nodes_checked, ok ? "true" : "false");
+#ifdef HAVE_RDTSC
+    printf("  \"cycle_counter\": \"rdtsc\",\n");
+#else
+    printf("  \"cycle_counter\": null,\n");
+#endif
+    // 线程数：小于 max_threads 的 2 的幂，最后是 max_threads 本身
+    std::vector<unsigned int> thread_counts;
+    for (uint64_t t = 1; t < max_threads; t *= 2) {
+        thread_counts.push_back((unsigned int) t);
+    }
+    thread_counts.push_back(max_threads);
+
+    printf("  \"implementations\": [\n");
+    for (size_t i = 0; i < IMPL_COUNT; i++) {
+        const Sm3Impl &impl = IMPLS[i];
+        Throughput tp = measure_throughput(impl, buf.data(), long_len);
+        printf("    {\n      \"name\": \"%s\",\n      \"lanes\": %d,\n", impl.name, impl.lanes);
+        printf("      \"long_message\": {\"bytes\": %zu, \"cycles_per_byte\": %.3f, \"mb_per_s\": %.1f},\n",
+               long_len, tp.cycles_per_byte, tp.mb_per_s);
+        printf("      \"short_message\": [");
+        for (size_t k = 0; k < sizeof(short_lens) / sizeof(short_lens[0]); k++) {
+            Latency lat = measure_latency(impl, buf.data(), short_lens[k]);
+            printf("%s{\"bytes\": %zu, \"ns\": %.1f, \"cycles\": %.0f}", k ? ", " : "", short_lens[k], lat.ns,
+                   lat.cycles);
+        }
+        printf("],\n");
+        printf("      \"threads\": [");
+        double base = 0;
+        bool first = true;
+        for (unsigned int t : thread_counts) {
+            double mbps = measure_scaling(impl, t, scaling_len);
+            if (t == 1) base = mbps;
+            printf("%s{\"threads\": %u, \"mb_per_s\": %.1f, \"speedup\": %.2f}", first ? "" : ", ", t, mbps,
+                   base > 0 ? mbps / base : 0.0);
+            first = false;
+        }
+        printf("]\n    }%s\n", i + 1 < IMPL_COUNT ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return ok ? 0 : 1;
+}
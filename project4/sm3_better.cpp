@@ -89,7 +89,7 @@ void sm3_get_hash(uint32_t *src, uint32_t *hash, uint32_t len) {
     }
     for (i = 0; i < len; i = i + 64) {
         if (len - i < 64)break;
-        sm3_one_block(hash, src + i);
+        sm3_one_block(hash, src + i / 4);  // i 是字节偏移，src 按字寻址
     }
     uint32_t last_block_len = len - i;
     uint32_t word_len = ((last_block_len + 3) >> 2) << 2;
@@ -116,20 +116,28 @@ void sm3_get_hash(uint32_t *src, uint32_t *hash, uint32_t len) {
             break;
     }
     if (last_block_len < 56) {
-        uint32_t bit_len = len << 3;
+        uint64_t bit_len = (uint64_t) len << 3;  // 长度字段为 64 比特，len >= 512MiB 时高位非零
         last_block[63] = (bit_len >> 24) & 0xff;
         last_block[62] = (bit_len >> 16) & 0xff;
         last_block[61] = (bit_len >> 8) & 0xff;
         last_block[60] = (bit_len) & 0xff;
+        last_block[59] = (bit_len >> 56) & 0xff;
+        last_block[58] = (bit_len >> 48) & 0xff;
+        last_block[57] = (bit_len >> 40) & 0xff;
+        last_block[56] = (bit_len >> 32) & 0xff;
         sm3_one_block(hash, (uint32_t *) last_block);
     } else {
         sm3_one_block(hash, (uint32_t *) last_block);
         unsigned char lblock[64] = {0};
-        uint32_t bit_len = len << 3;
+        uint64_t bit_len = (uint64_t) len << 3;  // 长度字段为 64 比特，len >= 512MiB 时高位非零
         lblock[63] = (bit_len >> 24) & 0xff;
         lblock[62] = (bit_len >> 16) & 0xff;
         lblock[61] = (bit_len >> 8) & 0xff;
         lblock[60] = (bit_len) & 0xff;
+        lblock[59] = (bit_len >> 56) & 0xff;
+        lblock[58] = (bit_len >> 48) & 0xff;
+        lblock[57] = (bit_len >> 40) & 0xff;
+        lblock[56] = (bit_len >> 32) & 0xff;
         sm3_one_block(hash, (uint32_t *) lblock);
     }
 }
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include "sm3.h"
+
+// HMAC-SM3 (RFC 2104)：HMAC(K, m) = H((K ^ opad) || H((K ^ ipad) || m))
+// K ^ ipad 与 K ^ opad 各占恰好一个分组，与消息无关，
+// 因此每个密钥只压缩一次，保存两个中间状态，之后每条消息从中间状态继续。
+
+typedef struct {
+    uint32_t ipad_state[8];   // 压缩 K ^ ipad 后的链接变量
+    uint32_t opad_state[8];   // 压缩 K ^ opad 后的链接变量
+} sm3_hmac_key;
+
+// 预计算密钥的内外层中间状态
+void sm3_hmac_init_key(sm3_hmac_key *hk, const uint8_t *key, size_t key_len) {
+    uint8_t k0[SM3_BLOCK_SIZE] = {0};
+    uint8_t pad[SM3_BLOCK_SIZE];
+
+    // 密钥长于一个分组时先做一次哈希
+    if (key_len > SM3_BLOCK_SIZE) {
+        sm3_digest(key, key_len, k0);
+    } else if (key_len) {
+        memcpy(k0, key, key_len);
+    }
+
+    for (int i = 0; i < SM3_BLOCK_SIZE; i++) pad[i] = k0[i] ^ 0x36;
+    memcpy(hk->ipad_state, SM3_IV, sizeof(hk->ipad_state));
+    sm3_compress_bytes(hk->ipad_state, pad);
+
+    for (int i = 0; i < SM3_BLOCK_SIZE; i++) pad[i] = k0[i] ^ 0x5c;
+    memcpy(hk->opad_state, SM3_IV, sizeof(hk->opad_state));
+    sm3_compress_bytes(hk->opad_state, pad);
+
+    memset(k0, 0, sizeof(k0));
+    memset(pad, 0, sizeof(pad));
+}
+
+// 外层哈希的输入固定为 32 字节内层摘要，填充后恰好一个分组，直接构造即可
+static inline void sm3_hmac_outer(const sm3_hmac_key *hk, const uint8_t *inner, uint8_t *mac) {
+    uint32_t block[16] = {0};
+    uint32_t hash[8];
+    for (int i = 0; i < 8; i++) {
+        block[i] = sm3_load_be32(inner + 4 * i);
+    }
+    block[8] = 0x80000000;
+    block[15] = (SM3_BLOCK_SIZE + SM3_DIGEST_SIZE) << 3;  // (64 + 32) * 8 比特
+    memcpy(hash, hk->opad_state, sizeof(hash));
+    sm3_one_block(hash, block);
+    sm3_hash_to_bytes(hash, mac);
+}
+
+// 计算单条消息的 MAC，短消息（<= 55 字节）只需两次压缩
+void sm3_hmac(const sm3_hmac_key *hk, const uint8_t *msg, size_t msg_len, uint8_t *mac) {
+    sm3_ctx ctx;
+    uint8_t inner[SM3_DIGEST_SIZE];
+    sm3_init_from(&ctx, hk->ipad_state, 1);
+    sm3_update(&ctx, msg, msg_len);
+    sm3_final(&ctx, inner);
+    sm3_hmac_outer(hk, inner, mac);
+}
+
+#ifdef SM3_HAVE_X8
+// 8 条等长消息同时计算：内层从 ipad 中间状态出发（总长度计入已压缩的一个分组），
+// 外层从 opad 中间状态出发压缩内层摘要所在的一个分组，两层都走 sm3_x8_compress
+static void sm3_hmac_x8(const sm3_hmac_key *hk, const uint8_t *const msgs[SM3_X8_LANES], size_t msg_len,
+                        uint8_t *const macs[SM3_X8_LANES]) {
+    sm3_x8_state st;
+    const uint8_t *blocks[SM3_X8_LANES];
+    uint8_t tail[SM3_X8_LANES][2 * SM3_BLOCK_SIZE];
+    uint8_t outer[SM3_X8_LANES][SM3_BLOCK_SIZE];
+    uint8_t *inners[SM3_X8_LANES];
+    size_t full = msg_len / SM3_BLOCK_SIZE;
+    size_t rest = msg_len % SM3_BLOCK_SIZE;
+    size_t tail_blocks = (rest + 9 <= SM3_BLOCK_SIZE) ? 1 : 2;
+    int i;
+
+    sm3_x8_init_from(&st, hk->ipad_state);
+    for (size_t b = 0; b < full; b++) {
+        for (i = 0; i < SM3_X8_LANES; i++) blocks[i] = msgs[i] + b * SM3_BLOCK_SIZE;
+        sm3_x8_compress(&st, blocks);
+    }
+    for (i = 0; i < SM3_X8_LANES; i++) {
+        memset(tail[i], 0, sizeof(tail[i]));
+        memcpy(tail[i], msgs[i] + full * SM3_BLOCK_SIZE, rest);
+        tail[i][rest] = 0x80;
+        sm3_store_be64(tail[i] + tail_blocks * SM3_BLOCK_SIZE - 8, (uint64_t) (SM3_BLOCK_SIZE + msg_len) << 3);
+    }
+    for (size_t b = 0; b < tail_blocks; b++) {
+        for (i = 0; i < SM3_X8_LANES; i++) blocks[i] = tail[i] + b * SM3_BLOCK_SIZE;
+        sm3_x8_compress(&st, blocks);
+    }
+    // 内层摘要直接写进外层分组的前 32 字节
+    for (i = 0; i < SM3_X8_LANES; i++) {
+        memset(outer[i], 0, SM3_BLOCK_SIZE);
+        outer[i][SM3_DIGEST_SIZE] = 0x80;
+        sm3_store_be64(outer[i] + SM3_BLOCK_SIZE - 8, (SM3_BLOCK_SIZE + SM3_DIGEST_SIZE) << 3);
+        inners[i] = outer[i];
+        blocks[i] = outer[i];
+    }
+    sm3_x8_final(&st, inners);
+    sm3_x8_init_from(&st, hk->opad_state);
+    sm3_x8_compress(&st, blocks);
+    sm3_x8_final(&st, macs);
+}
+#endif
+
+// 同一密钥下批量计算多条消息的 MAC。启用 AVX2 时按长度分组，等长的消息每 8 条一起走 8 路内核，
+// 凑不满 8 条的逐条计算
+void sm3_hmac_batch(const sm3_hmac_key *hk, const uint8_t *const *msgs, const size_t *msg_lens,
+                    size_t count, uint8_t (*macs)[SM3_DIGEST_SIZE]) {
+#ifdef SM3_HAVE_X8
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return msg_lens[a] < msg_lens[b]; });
+    size_t i = 0;
+    while (i < count) {
+        size_t len = msg_lens[order[i]];
+        size_t end = i;
+        while (end < count && msg_lens[order[end]] == len) end++;
+        for (; i + SM3_X8_LANES <= end; i += SM3_X8_LANES) {
+            const uint8_t *lane_msgs[SM3_X8_LANES];
+            uint8_t *lane_macs[SM3_X8_LANES];
+            for (int k = 0; k < SM3_X8_LANES; k++) {
+                lane_msgs[k] = msgs[order[i + k]];
+                lane_macs[k] = macs[order[i + k]];
+            }
+            sm3_hmac_x8(hk, lane_msgs, len, lane_macs);
+        }
+        for (; i < end; i++) {
+            sm3_hmac(hk, msgs[order[i]], len, macs[order[i]]);
+        }
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        sm3_hmac(hk, msgs[i], msg_lens[i], macs[i]);
+    }
+#endif
+}
+
+// 常数时间比较，避免通过比较耗时泄露 MAC
+int sm3_hmac_verify(const sm3_hmac_key *hk, const uint8_t *msg, size_t msg_len, const uint8_t *mac) {
+    uint8_t expect[SM3_DIGEST_SIZE];
+    uint8_t diff = 0;
+    sm3_hmac(hk, msg, msg_len, expect);
+    for (int i = 0; i < SM3_DIGEST_SIZE; i++) {
+        diff |= expect[i] ^ mac[i];
+    }
+    return diff == 0;
+}
+
+static void print_mac(const char *label, const uint8_t *mac) {
+    printf("%s", label);
+    for (int i = 0; i < SM3_DIGEST_SIZE; i++) printf("%02x", mac[i]);
+    printf("\n");
+}
+
+int main() {
+    const char *key = "key";
+    const char *msg = "The quick brown fox jumps over the lazy dog";
+    uint8_t mac[SM3_DIGEST_SIZE];
+
+    sm3_hmac_key hk;
+    sm3_hmac_init_key(&hk, (const uint8_t *) key, strlen(key));
+    sm3_hmac(&hk, (const uint8_t *) msg, strlen(msg), mac);
+    print_mac("HMAC-SM3(key, msg): ", mac);
+
+    printf("验证原消息: %s\n", sm3_hmac_verify(&hk, (const uint8_t *) msg, strlen(msg), mac) ? "通过" : "失败");
+    const char *forged = "The quick brown fox jumps over the lazy dog!";
+    printf("验证篡改消息: %s\n", sm3_hmac_verify(&hk, (const uint8_t *) forged, strlen(forged), mac) ? "通过" : "失败");
+
+    // 批量计算：同一密钥，中间状态只预计算一次
+    const char *reqs[3] = {"GET /api/v1/users", "POST /api/v1/orders", ""};
+    const uint8_t *ptrs[3];
+    size_t lens[3];
+    uint8_t macs[3][SM3_DIGEST_SIZE];
+    for (int i = 0; i < 3; i++) {
+        ptrs[i] = (const uint8_t *) reqs[i];
+        lens[i] = strlen(reqs[i]);
+    }
+    sm3_hmac_batch(&hk, ptrs, lens, 3, macs);
+    for (int i = 0; i < 3; i++) {
+        printf("\"%s\": ", reqs[i]);
+        print_mac("", macs[i]);
+    }
+
+    // 大批量：长度 0 到 199 字节，多数长度有 8 条以上，与逐条计算的结果比较并计时
+    const size_t count = 100000;
+    std::vector<uint8_t> data(count * 200);
+    std::vector<const uint8_t *> batch_ptrs(count);
+    std::vector<size_t> batch_lens(count);
+    std::vector<uint8_t> batch_out(count * SM3_DIGEST_SIZE), single_out(count * SM3_DIGEST_SIZE);
+    uint8_t (*batch_macs)[SM3_DIGEST_SIZE] = (uint8_t (*)[SM3_DIGEST_SIZE]) batch_out.data();
+    uint8_t (*single_macs)[SM3_DIGEST_SIZE] = (uint8_t (*)[SM3_DIGEST_SIZE]) single_out.data();
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t) (i * 131 + (i >> 8));
+    for (size_t i = 0; i < count; i++) {
+        batch_ptrs[i] = data.data() + i * 200;
+        batch_lens[i] = i * 7919 % 200;
+    }
+    clock_t start = clock();
+    for (size_t i = 0; i < count; i++) {
+        sm3_hmac(&hk, batch_ptrs[i], batch_lens[i], single_macs[i]);
+    }
+    double single_ms = (double) (clock() - start) * 1000 / CLOCKS_PER_SEC;
+    start = clock();
+    sm3_hmac_batch(&hk, batch_ptrs.data(), batch_lens.data(), count, batch_macs);
+    double batch_ms = (double) (clock() - start) * 1000 / CLOCKS_PER_SEC;
+    int same = memcmp(batch_out.data(), single_out.data(), batch_out.size()) == 0;
+    printf("批量 %zu 条: 逐条 %.1f ms, 批量 %.1f ms, 结果%s\n", count, single_ms, batch_ms, same ? "一致" : "不一致");
+    return same ? 0 : 1;
+}
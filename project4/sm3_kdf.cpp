@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "sm3.h"
+
+// SM3 密钥派生函数（GB/T 32918.4）：K = SM3(Z || ct_1) || SM3(Z || ct_2) || ...，ct 从 1 开始
+// 编译为动态库供 SM2 工具调用：g++ -O2 -mavx2 -shared -fPIC sm3_kdf.cpp -o libsm3kdf.so
+//
+// 优化：
+// 1. Z 中完整的分组与计数器无关，只压缩一次，保存中间状态；
+// 2. 剩余的 Z 尾部 || ct || 填充 || 长度 对所有计数器只有 ct 的 4 个字节不同，
+//    预先构造好最后一到两个分组的模板，每个计数器只改写这 4 个字节再压缩。
+// 3. 启用 AVX2 时每 8 个计数器的分组用 8 路 SM3 同时压缩。
+// 对 SM2 常见的 Z = x2 || y2（64 字节），每个计数器只需一次压缩。
+
+typedef struct {
+    uint32_t midstate[8];                   // 压缩 Z 的完整分组后的链接变量
+    uint8_t tail[2 * SM3_BLOCK_SIZE];       // Z 尾部 || ct || 填充 || 长度
+    uint32_t tail_blocks;                   // tail 占用的分组数（1 或 2）
+    uint32_t ct_offset;                     // ct 在 tail 中的偏移
+} sm3_kdf_ctx;
+
+static void sm3_kdf_prepare(sm3_kdf_ctx *kc, const uint8_t *z, size_t z_len) {
+    sm3_ctx ctx;
+    sm3_init(&ctx);
+    sm3_update(&ctx, z, z_len);
+    memcpy(kc->midstate, ctx.digest, sizeof(kc->midstate));
+
+    uint32_t num = ctx.num;
+    kc->tail_blocks = (num + 4 + 9 <= SM3_BLOCK_SIZE) ? 1 : 2;
+    kc->ct_offset = num;
+    memset(kc->tail, 0, sizeof(kc->tail));
+    memcpy(kc->tail, ctx.block, num);
+    kc->tail[num + 4] = 0x80;
+    uint64_t bit_len = ((uint64_t) z_len + 4) << 3;
+    sm3_store_be64(kc->tail + kc->tail_blocks * SM3_BLOCK_SIZE - 8, bit_len);
+}
+
+// 批量计算计数器 ct_start .. ct_start + count - 1 的摘要，依次写入 out。
+// 各计数器的分组互不相关，启用 AVX2 时每 8 个计数器一组交给 8 路内核，剩余的逐个压缩
+static void sm3_kdf_blocks(const sm3_kdf_ctx *kc, uint32_t ct_start, size_t count, uint8_t *out) {
+    size_t i = 0;
+#ifdef SM3_HAVE_X8
+    uint8_t lanes[SM3_X8_LANES][2 * SM3_BLOCK_SIZE];
+    const uint8_t *blocks[SM3_X8_LANES];
+    uint8_t *outs[SM3_X8_LANES];
+    for (int k = 0; k < SM3_X8_LANES; k++) {
+        memcpy(lanes[k], kc->tail, sizeof(lanes[k]));
+    }
+    for (; i + SM3_X8_LANES <= count; i += SM3_X8_LANES) {
+        sm3_x8_state st;
+        sm3_x8_init_from(&st, kc->midstate);
+        for (int k = 0; k < SM3_X8_LANES; k++) {
+            sm3_store_be32(lanes[k] + kc->ct_offset, ct_start + (uint32_t) (i + k));
+            blocks[k] = lanes[k];
+            outs[k] = out + (i + k) * SM3_DIGEST_SIZE;
+        }
+        sm3_x8_compress(&st, blocks);
+        if (kc->tail_blocks == 2) {
+            for (int k = 0; k < SM3_X8_LANES; k++) blocks[k] = lanes[k] + SM3_BLOCK_SIZE;
+            sm3_x8_compress(&st, blocks);
+        }
+        sm3_x8_final(&st, outs);
+    }
+#endif
+    uint8_t tail[2 * SM3_BLOCK_SIZE];
+    uint32_t hash[8];
+    memcpy(tail, kc->tail, sizeof(tail));
+    for (; i < count; i++) {
+        sm3_store_be32(tail + kc->ct_offset, ct_start + (uint32_t) i);
+        memcpy(hash, kc->midstate, sizeof(hash));
+        sm3_compress_bytes(hash, tail);
+        if (kc->tail_blocks == 2) {
+            sm3_compress_bytes(hash, tail + SM3_BLOCK_SIZE);
+        }
+        sm3_hash_to_bytes(hash, out + i * SM3_DIGEST_SIZE);
+    }
+}
+
+extern "C" {
+
+// 派生 klen 字节密钥写入 out，成功返回 0；klen 超过 (2^32 - 1) * 32 字节返回 -1
+int sm3_kdf(const uint8_t *z, size_t z_len, uint8_t *out, size_t klen) {
+    if ((uint64_t) klen > (uint64_t) 0xffffffff * SM3_DIGEST_SIZE) {
+        return -1;
+    }
+    if (klen == 0) {
+        return 0;
+    }
+
+    sm3_kdf_ctx kc;
+    sm3_kdf_prepare(&kc, z, z_len);
+
+    size_t full = klen / SM3_DIGEST_SIZE;
+    size_t rest = klen % SM3_DIGEST_SIZE;
+    // 完整的摘要直接写入输出缓冲区
+    sm3_kdf_blocks(&kc, 1, full, out);
+    if (rest) {
+        uint8_t last[SM3_DIGEST_SIZE];
+        sm3_kdf_blocks(&kc, (uint32_t) full + 1, 1, last);
+        memcpy(out + full * SM3_DIGEST_SIZE, last, rest);
+    }
+    return 0;
+}
+
+}
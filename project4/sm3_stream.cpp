@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sm3.h"
+
+// 对大文件做可断点续算的 SM3：
+// 每处理一段数据就把流式状态导出到检查点文件，进程重启后从检查点继续，
+// 不必从第 0 字节重新计算。检查点记录输入文件的标识（大小、修改时间、开头至多 4 KiB 的 SM3），
+// 文件被替换、截断或修改过时不使用检查点，从头计算。
+//
+// 用法: ./sm3_stream <文件> <检查点文件> [检查点间隔MiB]
+
+#define READ_BUF_SIZE (1 << 20)
+
+// 输入文件标识：大小(8) | 修改时间纳秒(8) | 开头至多 INPUT_ID_PREFIX 字节的 SM3(32)，大端
+#define INPUT_ID_PREFIX 4096
+#define INPUT_ID_SIZE (8 + 8 + SM3_DIGEST_SIZE)
+
+static int input_identity(FILE *in, uint8_t *id) {
+    struct stat st;
+    int fd = fileno(in);
+    if (fstat(fd, &st) != 0) return -1;
+    uint8_t prefix[INPUT_ID_PREFIX];
+    size_t want = (uint64_t) st.st_size < INPUT_ID_PREFIX ? (size_t) st.st_size : INPUT_ID_PREFIX;
+    if (pread(fd, prefix, want, 0) != (ssize_t) want) return -1;
+    sm3_store_be64(id, (uint64_t) st.st_size);
+    sm3_store_be64(id + 8, (uint64_t) st.st_mtim.tv_sec * 1000000000ull + (uint64_t) st.st_mtim.tv_nsec);
+    sm3_digest(prefix, want, id + 16);
+    return 0;
+}
+
+// 把文件或目录的内容刷到磁盘
+static int sync_path(const char *path, int flags) {
+    int fd = open(path, flags);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+// 先写临时文件并 fsync，再改名并 fsync 所在目录：崩溃后检查点要么是旧的，要么是完整的新内容
+static int save_checkpoint(const char *path, const uint8_t *id, const sm3_ctx *ctx) {
+    uint8_t buf[INPUT_ID_SIZE + SM3_STATE_MAX_SIZE];
+    memcpy(buf, id, INPUT_ID_SIZE);
+    size_t len = INPUT_ID_SIZE + sm3_state_export(ctx, buf + INPUT_ID_SIZE);
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) return -1;
+    if (fwrite(buf, 1, len, fp) != len || fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    if (rename(tmp_path, path) != 0) return -1;
+
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) {
+        strcpy(dir, ".");
+    } else if (slash == dir) {
+        dir[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+    return sync_path(dir, O_RDONLY | O_DIRECTORY);
+}
+
+// 读取检查点：文件不存在或内容无效时返回 -1，与输入文件标识不符时返回 -2
+static int load_checkpoint(const char *path, const uint8_t *id, sm3_ctx *ctx) {
+    uint8_t buf[INPUT_ID_SIZE + SM3_STATE_MAX_SIZE + 1];
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    size_t len = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    if (len < INPUT_ID_SIZE) return -1;
+    if (sm3_state_import(ctx, buf + INPUT_ID_SIZE, len - INPUT_ID_SIZE) != 0) return -1;
+    return memcmp(buf, id, INPUT_ID_SIZE) == 0 ? 0 : -2;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "用法: %s <文件> <检查点文件> [检查点间隔MiB]\n", argv[0]);
+        return 1;
+    }
+    const char *input_path = argv[1];
+    const char *checkpoint_path = argv[2];
+    uint64_t interval = (argc > 3 ? strtoull(argv[3], NULL, 10) : 256) << 20;
+    if (interval == 0) interval = READ_BUF_SIZE;
+
+    FILE *in = fopen(input_path, "rb");
+    if (!in) {
+        fprintf(stderr, "无法打开 %s\n", input_path);
+        return 1;
+    }
+
+    uint8_t id[INPUT_ID_SIZE];
+    if (input_identity(in, id) != 0) {
+        fprintf(stderr, "无法读取 %s 的文件信息\n", input_path);
+        fclose(in);
+        return 1;
+    }
+
+    sm3_ctx ctx;
+    uint64_t offset = 0;
+    int loaded = load_checkpoint(checkpoint_path, id, &ctx);
+    if (loaded == -2) {
+        printf("检查点与输入文件不符（文件已被替换或修改），从头计算\n");
+    }
+    if (loaded == 0) {
+        offset = ctx.nblocks * SM3_BLOCK_SIZE + ctx.num;
+        if (fseeko(in, (off_t) offset, SEEK_SET) != 0) {
+            fprintf(stderr, "无法定位到检查点偏移 %llu\n", (unsigned long long) offset);
+            fclose(in);
+            return 1;
+        }
+        printf("从检查点恢复，偏移 %llu 字节\n", (unsigned long long) offset);
+    } else {
+        sm3_init(&ctx);
+    }
+
+    uint8_t *buf = (uint8_t *) malloc(READ_BUF_SIZE);
+    if (!buf) {
+        fclose(in);
+        return 1;
+    }
+    uint64_t next_checkpoint = offset + interval;
+    size_t n;
+    while ((n = fread(buf, 1, READ_BUF_SIZE, in)) > 0) {
+        sm3_update(&ctx, buf, n);
+        offset += n;
+        if (offset >= next_checkpoint) {
+            if (save_checkpoint(checkpoint_path, id, &ctx) != 0) {
+                fprintf(stderr, "写入检查点失败\n");
+            }
+            next_checkpoint = offset + interval;
+        }
+    }
+    int read_error = ferror(in);
+    free(buf);
+    fclose(in);
+    if (read_error) {
+        // 读取出错时保留当前进度，下次从这里继续
+        save_checkpoint(checkpoint_path, id, &ctx);
+        fprintf(stderr, "读取 %s 出错，进度已保存到检查点\n", input_path);
+        return 1;
+    }
+
+    uint8_t digest[SM3_DIGEST_SIZE];
+    sm3_final(&ctx, digest);
+    for (int i = 0; i < SM3_DIGEST_SIZE; i++) printf("%02x", digest[i]);
+    printf("  %s\n", input_path);
+    remove(checkpoint_path);
+    return 0;
+}
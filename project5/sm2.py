@@ -1,5 +1,7 @@
 import secrets
 import struct
+import ctypes
+import os
 from math import gcd, ceil, log
 from gmssl import sm3
 from typing import Tuple, Optional, List
@@ -13,6 +15,21 @@ SM2_N = 0x8542D69E4C044F18E8B92435BF6FF7DD297720630485628D5AE74EE7C32E79B7
 SM2_GX = 0x421DEBD61B62EAB6746434EBC3CC315E32220B3BADD50BDC4C4E6C147FEDD43D
 SM2_GY = 0x0680512BCBB42C07D47349D2153B70C4E5D7FDFCBFA36EA1A85841B9E46E09A2
 
+# project4 中的原生 SM3-KDF 动态库（g++ -O2 -mavx2 -shared -fPIC sm3_kdf.cpp -o libsm3kdf.so），
+# 可用环境变量 SM3_KDF_LIB 指定路径，加载失败时退回纯 Python 实现
+def _load_sm3_kdf_lib():
+    path = os.environ.get('SM3_KDF_LIB') or os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), '..', 'project4', 'libsm3kdf.so')
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+    lib.sm3_kdf.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_char_p, ctypes.c_size_t]
+    lib.sm3_kdf.restype = ctypes.c_int
+    return lib
+
+_SM3_KDF_LIB = _load_sm3_kdf_lib()
+
 # 缓存常用计算结果
 _FIELD_BYTES = ceil(ceil(log(SM2_P, 2)) / 8)
 _POINT_BYTES = 2 * _FIELD_BYTES + 1
@@ -194,6 +211,13 @@ class OptimizedSM2:
         if klen >= (2**32 - 1) * v:
             raise ValueError("密钥长度超出限制")
         
+        # 优先使用原生实现：Z 的中间状态只算一次，所有计数器分组一次调用算完
+        if _SM3_KDF_LIB is not None:
+            out = ctypes.create_string_buffer(klen)
+            if _SM3_KDF_LIB.sm3_kdf(Z, len(Z), out, klen) != 0:
+                raise ValueError("密钥长度超出限制")
+            return out.raw
+        
         ct = 1
         k = b''
         